@@ -0,0 +1,253 @@
+#include "ChunkFile.hpp"
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for reading.");
+	}
+	file_handle = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+
+	//(zero-length files can't be mapped, but they also don't have any chunks)
+	if (size != 0) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		mapping_handle = mapping;
+		base = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!base) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map view of '" + filename + "'.");
+		}
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "' for reading.");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(st.st_size);
+
+	//(zero-length files can't be mapped, but they also don't have any chunks)
+	if (size != 0) {
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		//chunks are (generally) consumed front-to-back:
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		base = reinterpret_cast< char const * >(mapped);
+	}
+
+	//the mapping keeps its own reference to the file:
+	close(fd);
+	#endif
+
+	//read chunk directory, if present:
+	if (size >= sizeof(ChunkHeader) && std::string(base, 4) == "dir0") {
+		try {
+			Span< ChunkDirectoryEntry > entries = read< ChunkDirectoryEntry >("dir0");
+			directory.assign(entries.begin(), entries.end());
+			for (auto const &entry : directory) {
+				if (!(entry.offset <= size && entry.size <= size - entry.offset)) {
+					throw error("Chunk directory entry is out of range.");
+				}
+			}
+		} catch (...) {
+			unmap(); //(destructor isn't called if constructor throws)
+			throw;
+		}
+		has_directory = true;
+		first = offset;
+	}
+}
+
+ChunkFile::~ChunkFile() {
+	unmap();
+}
+
+void ChunkFile::unmap() {
+	#if defined(_WIN32)
+	if (base) UnmapViewOfFile(base);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+	#else
+	if (base) munmap(const_cast< char * >(base), size);
+	#endif
+	base = nullptr;
+}
+
+ChunkFile::Chunk ChunkFile::chunk_at(size_t at, std::string const &magic) const {
+	assert(magic.size() == 4);
+	assert(at <= size);
+
+	Chunk chunk;
+	size_t header = 0;
+	try {
+		header = parse_chunk_header(base + at, size - at, magic, &chunk.info);
+	} catch (std::runtime_error &e) {
+		throw error(e.what() + std::string(" (at byte ") + std::to_string(at) + ")");
+	}
+	if (size - at - header < chunk.info.stored) {
+		throw error("Chunk '" + magic + "' runs past end of file.");
+	}
+	chunk.offset = at + header;
+	return chunk;
+}
+
+ChunkFile::Chunk ChunkFile::skip(std::string const &magic) {
+	Chunk chunk = chunk_at(offset, magic);
+	seek_past(chunk);
+	return chunk;
+}
+
+bool ChunkFile::find(std::string const &magic, Chunk *chunk) const {
+	assert(magic.size() == 4);
+	assert(chunk);
+
+	if (has_directory) {
+		for (auto const &entry : directory) {
+			if (std::string(entry.magic, 4) == magic) {
+				*chunk = chunk_at(size_t(entry.offset), magic);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//no directory, so walk chunk headers (this only touches the headers, not the chunk data):
+	for (size_t at = first; size - at >= sizeof(ChunkHeader); /* later */) {
+		std::string at_magic = chunk_magic(base + at);
+		Chunk at_chunk = chunk_at(at, at_magic);
+		if (at_magic == magic) {
+			*chunk = at_chunk;
+			return true;
+		}
+		at = at_chunk.offset + size_t(at_chunk.info.stored);
+	}
+	return false;
+}
+
+void ChunkFile::seek_past(Chunk const &chunk) {
+	assert(chunk.offset + chunk.info.stored <= size);
+	offset = chunk.offset + size_t(chunk.info.stored);
+}
+
+uint64_t ChunkFile::data_size(Chunk const &chunk) const {
+	assert(chunk.offset + chunk.info.stored <= size);
+	if (chunk.info.compressed) {
+		try {
+			return uncompressed_chunk_size(base + chunk.offset, size_t(chunk.info.stored));
+		} catch (std::runtime_error &e) {
+			throw error(e.what());
+		}
+	} else {
+		return chunk.info.stored;
+	}
+}
+
+void ChunkFile::chunk_bytes(Chunk const &chunk, char const **data, size_t *bytes) {
+	assert(data);
+	assert(bytes);
+	assert(chunk.offset + chunk.info.stored <= size);
+
+	*data = base + chunk.offset;
+	*bytes = size_t(chunk.info.stored);
+
+	//compressed chunks can't be used in place, so inflate into owned storage:
+	if (chunk.info.compressed) {
+		uint64_t uncompressed = data_size(chunk);
+		if (uncompressed > size_t(-1)) {
+			throw error("Compressed chunk is too large to inflate in memory.");
+		}
+		aligned_copies.emplace_back(new char[uncompressed == 0 ? 1 : size_t(uncompressed)]);
+		try {
+			decompress_chunk_data(*data, *bytes, aligned_copies.back().get());
+		} catch (std::runtime_error &e) {
+			throw error(e.what());
+		}
+		*data = aligned_copies.back().get();
+		*bytes = size_t(uncompressed);
+	}
+}
+
+void ChunkFile::read_piece_bytes(Chunk const &chunk, size_t element_size, size_t element_align, size_t max_piece_bytes, std::function< void(char const *, size_t) > const &on_piece) {
+	assert(chunk.offset + chunk.info.stored <= size);
+
+	char const *data = base + chunk.offset;
+
+	//plain, aligned chunks can be handed out straight from the mapping:
+	if (!chunk.info.compressed && reinterpret_cast< uintptr_t >(data) % element_align == 0) {
+		if (chunk.info.stored % element_size != 0) {
+			throw error("Size of chunk not divisible by element size");
+		}
+		size_t piece_bytes = max_piece_bytes - max_piece_bytes % element_size;
+		if (piece_bytes == 0) {
+			throw error("Chunk piece size is smaller than one element.");
+		}
+		for (size_t at = 0; at < chunk.info.stored; at += piece_bytes) {
+			on_piece(data + at, std::min(piece_bytes, size_t(chunk.info.stored) - at));
+		}
+		return;
+	}
+
+	//otherwise, copy (or inflate) through a piece buffer:
+	// (errors from on_piece get the filename added too, which does no harm)
+	size_t at = 0;
+	try {
+		read_chunk_pieces(chunk.info,
+			[&](char *to, size_t bytes) {
+				assert(at + bytes <= chunk.info.stored);
+				std::memcpy(to, data + at, bytes);
+				at += bytes;
+			},
+			element_size, max_piece_bytes, on_piece
+		);
+	} catch (std::runtime_error &e) {
+		throw error(e.what());
+	}
+}
+
+std::runtime_error ChunkFile::error(std::string const &message) const {
+	return std::runtime_error("'" + filename + "': " + message);
+}
+
+char const *ChunkFile::copy_aligned(char const *data, size_t bytes) {
+	//operator new[] returns storage aligned for any fundamental type:
+	aligned_copies.emplace_back(new char[bytes == 0 ? 1 : bytes]);
+	std::memcpy(aligned_copies.back().get(), data, bytes);
+	return aligned_copies.back().get();
+}
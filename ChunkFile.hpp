@@ -0,0 +1,187 @@
+#pragma once
+
+/*
+ * A "ChunkFile" maps a chunk-based binary file (the format written by
+ *  write_chunk() in read_write_chunk.hpp) into memory and hands out
+ *  read-only views of its chunks without copying them.
+ *
+ * Chunks are read in order, just like a sequence of read_chunk() calls:
+ *
+ *   ChunkFile file(filename);
+ *   ChunkFile::Span< char > strings = file.read< char >("str0");
+ *   ChunkFile::Span< Entry > entries = file.read< Entry >("idx0");
+ *
+ * Spans stay valid as long as the ChunkFile they came from.
+ * (Compressed chunks are inflated on read, so they do cost a copy.)
+ *
+ * If the file starts with a chunk directory (see read_write_chunk.hpp), it is
+ *  used to find chunks without walking the file; either way, find() can locate
+ *  chunks out of order:
+ *
+ *   ChunkFile::Chunk lights;
+ *   if (file.find("lmp0", &lights)) { ... file.read< LightEntry >(lights) ... }
+ *
+ * Very large chunks can also be skipped over and read later a piece at a time:
+ *
+ *   ChunkFile::Chunk vertices = file.skip("pnct");
+ *   ...
+ *   file.read_pieces< Vertex >(vertices, 65536, [](ChunkFile::Span< Vertex > const &piece, size_t first){ ... });
+ *
+ */
+
+#include "read_write_chunk.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+struct ChunkFile {
+	//map a file:
+	// note: will throw if the file can't be opened or mapped.
+	ChunkFile(std::string const &filename);
+	~ChunkFile();
+
+	//the mapping is owned, so copying is not allowed:
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	//A "Span" is a read-only array view into a chunk:
+	template< typename T >
+	struct Span {
+		Span() = default;
+		Span(T const *data_, size_t size_) : ptr(data_), count(size_) { }
+
+		T const *data() const { return ptr; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		T const *begin() const { return ptr; }
+		T const *end() const { return ptr + count; }
+		T const &operator[](size_t i) const { return ptr[i]; }
+
+	private:
+		T const *ptr = nullptr;
+		size_t count = 0;
+	};
+
+	//A "Chunk" records where a chunk's data is in the file:
+	struct Chunk {
+		size_t offset = 0; //start of (stored) chunk data
+		ChunkInfo info; //stored size, compression
+	};
+
+	//check the header of the next chunk, which must have the given magic number, and move past it:
+	// note: will throw if the chunk header is bad or the chunk runs past the end of the file.
+	Chunk skip(std::string const &magic);
+
+	//find the first chunk with the given magic number anywhere in the file, without reading its data:
+	// uses the chunk directory if there is one; otherwise walks chunk headers from the start of the file.
+	// returns false if there is no such chunk. (does not change the read position)
+	bool find(std::string const &magic, Chunk *chunk) const;
+
+	//move the read position (used by skip() and read(magic)) to just after a chunk:
+	void seek_past(Chunk const &chunk);
+
+	//did the file start with a chunk directory?
+	bool has_directory = false;
+
+	//size of a chunk's data (after decompression, if compressed):
+	uint64_t data_size(Chunk const &chunk) const;
+
+	//read the next chunk, which must have the given magic number:
+	// note: will throw if the chunk header is bad or the chunk runs past the end of the file.
+	template< typename T >
+	Span< T > read(std::string const &magic) { return read< T >(skip(magic)); }
+
+	//read a chunk returned by skip():
+	template< typename T >
+	Span< T > read(Chunk const &chunk);
+
+	//read a chunk returned by skip() in pieces of at most max_piece_count elements:
+	// on_piece(piece, first) gets chunk elements [first, first + piece.size()); piece is only valid during the call.
+	// Plain chunks are handed out directly from the mapping; compressed ones are inflated a block at a time,
+	// so reading never holds more than a piece (plus a block) of extra memory.
+	template< typename T >
+	void read_pieces(Chunk const &chunk, size_t max_piece_count, std::function< void(Span< T > const &, size_t) > const &on_piece);
+
+	//is there any data after the last chunk read?
+	bool at_end() const { return offset == size; }
+
+	//the unread part of the file (e.g., for handing to code that wants a stream):
+	char const *remaining_begin() const { return base + offset; }
+	char const *remaining_end() const { return base + size; }
+
+	//-- internals ---
+
+	//returns the data range of a chunk:
+	// (compressed chunks are inflated into owned storage first)
+	void chunk_bytes(Chunk const &chunk, char const **data, size_t *bytes);
+
+	//non-template part of read_pieces (pieces are whole elements with the given alignment):
+	void read_piece_bytes(Chunk const &chunk, size_t element_size, size_t element_align, size_t max_piece_bytes, std::function< void(char const *, size_t) > const &on_piece);
+
+	//releases the mapping (and, on Windows, the file handles):
+	void unmap();
+
+	//returns a suitably-aligned copy of a chunk (used when a chunk starts at a misaligned offset):
+	char const *copy_aligned(char const *data, size_t bytes);
+
+	std::string filename; //for error messages
+	//an error about the file's contents (message prefixed with the filename):
+	std::runtime_error error(std::string const &message) const;
+	char const *base = nullptr; //start of mapping
+	size_t size = 0; //size of mapping
+	size_t offset = 0; //start of next chunk header
+	size_t first = 0; //start of first chunk header after the directory (if any)
+
+	//entries from the chunk directory:
+	std::vector< ChunkDirectoryEntry > directory;
+
+	//checks the header of a chunk starting at 'at' (which must have the given magic number):
+	Chunk chunk_at(size_t at, std::string const &magic) const;
+
+	//platform-specific mapping handles:
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+
+	//copies made by copy_aligned() and inflated compressed chunks:
+	std::vector< std::unique_ptr< char[] > > aligned_copies;
+};
+
+template< typename T >
+ChunkFile::Span< T > ChunkFile::read(Chunk const &chunk) {
+	static_assert(std::is_trivially_copyable< T >::value, "Chunk elements must be plain data.");
+
+	char const *data = nullptr;
+	size_t bytes = 0;
+	chunk_bytes(chunk, &data, &bytes);
+
+	if (bytes % sizeof(T) != 0) {
+		throw error("Size of chunk not divisible by element size");
+	}
+
+	//chunks following (e.g.) a string chunk may not be aligned well enough to use in-place:
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		data = copy_aligned(data, bytes);
+	}
+
+	return Span< T >(reinterpret_cast< T const * >(data), bytes / sizeof(T));
+}
+
+template< typename T >
+void ChunkFile::read_pieces(Chunk const &chunk, size_t max_piece_count, std::function< void(Span< T > const &, size_t) > const &on_piece) {
+	static_assert(std::is_trivially_copyable< T >::value, "Chunk elements must be plain data.");
+	assert(max_piece_count > 0);
+
+	size_t first = 0;
+	read_piece_bytes(chunk, sizeof(T), alignof(T), max_piece_count * sizeof(T), [&](char const *data, size_t bytes) {
+		on_piece(Span< T >(reinterpret_cast< T const * >(data), bytes / sizeof(T)), first);
+		first += bytes / sizeof(T);
+	});
+}
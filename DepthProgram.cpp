@@ -0,0 +1,55 @@
+#include "DepthProgram.hpp"
+
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+Material::Handle depth_program_material;
+
+Load< DepthProgram > depth_program(LoadTagEarly, []() -> DepthProgram const * {
+	DepthProgram *ret = new DepthProgram();
+
+	Material &material = Material::make();
+	material.program = ret->program;
+	material.object_block = true; //(so drawables of the same mesh are drawn with one instanced call)
+	depth_program_material = Material::handle(material);
+
+	return ret;
+});
+
+DepthProgram::DepthProgram() {
+	//(same block as LitColorTextureProgram's; only OBJECT_TO_CLIP is used)
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"struct Object {\n"
+		"	mat4 OBJECT_TO_CLIP;\n"
+		"	mat4x3 OBJECT_TO_LIGHT;\n"
+		"	mat3 NORMAL_TO_LIGHT;\n"
+		"};\n"
+		"layout(std140) uniform Objects {\n"
+		"	Object OBJECTS[" + std::to_string(Scene::MaxObjects) + "];\n"
+		"};\n"
+		"in vec4 Position;\n"
+		//(computed exactly as in the color pass's program, so a GL_LEQUAL test after the pre-pass passes for the same surfaces)
+		"invariant gl_Position;\n"
+		"void main() {\n"
+		"	gl_Position = OBJECTS[gl_InstanceID].OBJECT_TO_CLIP * Position;\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"void main() {\n"
+		"}\n"
+	);
+
+	//look up the locations of vertex attributes:
+	Position_vec4 = glGetAttribLocation(program, "Position");
+
+	//point the uniform block at the buffer Scene::draw_depth binds:
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Objects"), Scene::ObjectsBinding);
+}
+
+DepthProgram::~DepthProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
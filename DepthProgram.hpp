@@ -0,0 +1,26 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+#include "Scene.hpp"
+
+//Shader program that only writes depth -- for a depth pre-pass (see Scene::draw_depth):
+// it reads nothing but Position, so a vao made for it from a MeshBuffer loaded with
+// StreamsSplitPositions fetches only the position stream.
+struct DepthProgram {
+	DepthProgram();
+	~DepthProgram();
+
+	GLuint program = 0;
+
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+
+	//Uniform blocks (filled in by Scene::draw_depth):
+	//Objects - per-object matrices (Scene::ObjectData), indexed by gl_InstanceID
+};
+
+extern Load< DepthProgram > depth_program;
+
+//material to pass to Scene::draw_depth:
+extern Material::Handle depth_program_material;
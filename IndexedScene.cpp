@@ -0,0 +1,91 @@
+#include "IndexedScene.hpp"
+
+#include <unordered_map>
+#include <stdexcept>
+
+glm::mat4 IndexedScene::Camera::make_projection() const {
+	return Scene::Camera::make_projection(fovy, aspect, near);
+}
+
+IndexedScene::IndexedScene(Scene const &scene) {
+	std::unordered_map< Scene::Transform const *, uint32_t > indices;
+	transforms.add(scene, &indices);
+
+	auto index_of = [&indices](Scene::Transform const *transform, char const *what) {
+		auto f = indices.find(transform);
+		if (f == indices.end()) {
+			throw std::runtime_error(std::string("Scene ") + what + " refers to a transform that isn't in the scene.");
+		}
+		return f->second;
+	};
+
+	std::vector< Scene::Drawable > *new_prototypes = new std::vector< Scene::Drawable >();
+	prototypes.reset(new_prototypes);
+	new_prototypes->reserve(scene.drawables.size());
+	drawables.reserve(scene.drawables.size());
+	for (auto const &d : scene.drawables) {
+		drawables.emplace_back();
+		drawables.back().transform = index_of(d.transform, "drawable");
+		drawables.back().prototype = uint32_t(new_prototypes->size());
+
+		new_prototypes->emplace_back(d);
+		new_prototypes->back().transform = nullptr;
+	}
+
+	cameras.reserve(scene.cameras.size());
+	for (auto const &c : scene.cameras) {
+		cameras.emplace_back();
+		cameras.back().transform = index_of(c.transform, "camera");
+		cameras.back().fovy = c.fovy;
+		cameras.back().aspect = c.aspect;
+		cameras.back().near = c.near;
+	}
+
+	lights.reserve(scene.lights.size());
+	for (auto const &l : scene.lights) {
+		lights.emplace_back();
+		lights.back().transform = index_of(l.transform, "light");
+		lights.back().type = l.type;
+		lights.back().energy = l.energy;
+		lights.back().spot_fov = l.spot_fov;
+	}
+
+	frame_payload = scene.frame_payload;
+	sort_drawables = scene.sort_drawables;
+}
+
+uint32_t IndexedScene::find_transform(Name const &name) const {
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		if (transforms.names[i] == name) return i;
+	}
+	return -1U;
+}
+
+void IndexedScene::draw(Camera const &camera) {
+	assert(camera.transform < transforms.size());
+	transforms.update();
+	glm::mat4 world_to_local = glm::inverse(glm::mat4(transforms.local_to_world[camera.transform]));
+	draw_updated(camera.make_projection() * world_to_local, glm::mat4x3(1.0f));
+}
+
+void IndexedScene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) {
+	transforms.update();
+	draw_updated(world_to_clip, world_to_light);
+}
+
+void IndexedScene::draw_updated(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) {
+	//list every drawable along with its world matrix, then let Scene do the rest:
+	draw_buffers.list.clear();
+	if (prototypes) {
+		draw_buffers.list.reserve(drawables.size());
+		for (auto const &d : drawables) {
+			assert(d.transform < transforms.size());
+			assert(d.prototype < prototypes->size());
+			draw_buffers.list.emplace_back();
+			draw_buffers.list.back().drawable = &(*prototypes)[d.prototype];
+			draw_buffers.list.back().object_to_world = &transforms.local_to_world[d.transform];
+		}
+	}
+
+	Scene::draw_list(draw_buffers, world_to_clip, world_to_light, sort_drawables, frame_payload, &draw_stats);
+}
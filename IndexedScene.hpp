@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+ * An "IndexedScene" holds the same sorts of things as a Scene -- transforms,
+ *  drawables, cameras, and lights -- but in flat arrays of plain values that
+ *  refer to each other by index rather than by pointer.
+ *
+ * So copying one is a handful of bulk copies, with no allocation per object
+ *  and no pointer fixup. This makes copies cheap enough to use for spawning
+ *  instances of a level or resetting one:
+ *
+ *   IndexedScene const level(*platformer_scene); //convert once
+ *   IndexedScene instance = level; //quick copy
+ *   uint32_t jewel = instance.find_transform(Name::find("jewel.001")); //(look up once, keep the index)
+ *   instance.transforms.set_position(jewel, instance.transforms.get_position(jewel) + step);
+ *   instance.draw(instance.cameras[0]);
+ *   ...
+ *   instance = level; //reset
+ *
+ * What drawables draw (pipelines, bounds, levels of detail) rarely changes, so
+ *  it is shared between copies rather than copied.
+ *
+ */
+
+#include "Scene.hpp"
+#include "TransformHierarchy.hpp"
+#include "Name.hpp"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+struct IndexedScene {
+	//transforms, with parents by index (see TransformHierarchy):
+	TransformHierarchy transforms;
+
+	struct Drawable {
+		uint32_t transform = -1U; //index in transforms
+		uint32_t prototype = -1U; //index in prototypes
+	};
+	std::vector< Drawable > drawables;
+
+	//what each drawable draws (pipeline, bounds, levels of detail), shared between copies:
+	// (these are copies of Scene drawables with their 'transform' set to nullptr)
+	std::shared_ptr< std::vector< Scene::Drawable > const > prototypes;
+
+	struct Camera {
+		uint32_t transform = -1U; //index in transforms
+		//NOTE: cameras are directed along their -z axis
+
+		//perspective camera parameters (as in Scene::Camera):
+		float fovy = glm::radians(60.0f); //vertical fov (in radians)
+		float aspect = 1.0f; //x / y
+		float near = 0.01f; //near plane
+		//computed from the above:
+		glm::mat4 make_projection() const;
+	};
+	std::vector< Camera > cameras;
+
+	struct Light {
+		uint32_t transform = -1U; //index in transforms
+
+		//(as in Scene::Light)
+		Scene::Light::Type type = Scene::Light::Point;
+		glm::vec3 energy = glm::vec3(1.0f);
+		float spot_fov = glm::radians(45.0f);
+	};
+	std::vector< Light > lights;
+
+	//empty scene:
+	IndexedScene() = default;
+
+	//copy a Scene's contents (each of its drawables becomes a prototype):
+	// throws if a drawable, camera, or light refers to a transform that isn't in the scene
+	explicit IndexedScene(Scene const &scene);
+
+	//look up a transform by name; returns -1U if there is no such transform:
+	// (a linear search -- look up names once and keep the index)
+	uint32_t find_transform(Name const &name) const;
+
+	//draw all the drawables (as Scene::draw does), after updating transforms.local_to_world:
+	void draw(Camera const &camera);
+	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f));
+
+	//drawing options and counts (as in Scene):
+	std::vector< char > frame_payload;
+	bool sort_drawables = true;
+	Scene::DrawStats draw_stats;
+	Scene::DrawBuffers draw_buffers; //(not copied)
+
+private:
+	//draw, once transforms are up to date:
+	void draw_updated(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light);
+};
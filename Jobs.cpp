@@ -0,0 +1,143 @@
+#include "Jobs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//local (to this file) data used by the job system:
+namespace {
+
+	//a 'Batch' is one parallel_for call's worth of work:
+	struct Batch {
+		Batch(std::function< void(uint32_t) > const &fn_, uint32_t count_) : fn(fn_), count(count_) { }
+		std::function< void(uint32_t) > const &fn;
+		uint32_t const count;
+
+		std::atomic< uint32_t > next{0}; //next index to claim
+		std::atomic< uint32_t > done{0}; //number of indices finished
+
+		std::mutex mutex; //protects 'error' and is used with 'finished'
+		std::condition_variable finished;
+		std::exception_ptr error;
+
+		//claim and run indices until there are none left:
+		void work() {
+			uint32_t ran = 0;
+			for (uint32_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+				try {
+					fn(i);
+				} catch (...) {
+					std::unique_lock< std::mutex > lock(mutex);
+					if (!error) error = std::current_exception();
+				}
+				ran += 1;
+			}
+			if (ran != 0 && done.fetch_add(ran) + ran == count) {
+				std::unique_lock< std::mutex > lock(mutex);
+				finished.notify_all();
+			}
+		}
+	};
+
+	struct Pool {
+		Pool() {
+			uint32_t hardware = std::thread::hardware_concurrency();
+			//the calling thread also works, so leave a core for it:
+			uint32_t count = std::max(1U, hardware) - 1;
+			workers.reserve(count);
+			for (uint32_t i = 0; i < count; ++i) {
+				workers.emplace_back([this](){ work(); });
+			}
+		}
+		~Pool() {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				quit = true;
+			}
+			wake.notify_all();
+			for (auto &worker : workers) {
+				worker.join();
+			}
+		}
+
+		//worker thread main loop:
+		void work() {
+			while (true) {
+				std::shared_ptr< Batch > batch;
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					wake.wait(lock, [this](){ return quit || !batches.empty(); });
+					if (quit) return;
+					batch = batches.front();
+					//batches stay queued until all of their indices have been claimed:
+					if (batch->next >= batch->count) {
+						batches.pop_front();
+						continue;
+					}
+				}
+				batch->work();
+			}
+		}
+
+		std::mutex mutex; //protects 'batches' and 'quit'
+		std::condition_variable wake;
+		std::deque< std::shared_ptr< Batch > > batches;
+		bool quit = false;
+
+		std::vector< std::thread > workers;
+	};
+
+	Pool &get_pool() {
+		static Pool pool;
+		return pool;
+	}
+}
+
+void Jobs::parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn) {
+	if (count == 0) return;
+
+	Pool &pool = get_pool();
+
+	//no point in waking workers for a single item (or if there aren't any):
+	if (count == 1 || pool.workers.empty()) {
+		for (uint32_t i = 0; i < count; ++i) {
+			fn(i);
+		}
+		return;
+	}
+
+	std::shared_ptr< Batch > batch = std::make_shared< Batch >(fn, count);
+	{
+		std::unique_lock< std::mutex > lock(pool.mutex);
+		pool.batches.emplace_back(batch);
+	}
+	pool.wake.notify_all();
+
+	//help out:
+	batch->work();
+
+	//make sure batch isn't left in the queue (all indices are claimed by now):
+	{
+		std::unique_lock< std::mutex > lock(pool.mutex);
+		auto f = std::find(pool.batches.begin(), pool.batches.end(), batch);
+		if (f != pool.batches.end()) pool.batches.erase(f);
+	}
+
+	//wait for any indices still running on workers:
+	{
+		std::unique_lock< std::mutex > lock(batch->mutex);
+		batch->finished.wait(lock, [&batch](){ return batch->done == batch->count; });
+	}
+
+	if (batch->error) std::rethrow_exception(batch->error);
+}
+
+uint32_t Jobs::thread_count() {
+	return uint32_t(get_pool().workers.size()) + 1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+/*
+ * "Jobs" is a small shared pool of worker threads for splitting up
+ *  CPU-heavy loops (decompression, mesh processing, etc).
+ *
+ * Workers are started the first time the pool is used and are joined at exit.
+ *
+ */
+
+#include <functional>
+#include <cstdint>
+
+namespace Jobs {
+
+//call fn(i) for every i in [0, count), spread across the worker threads and the calling thread:
+// returns once all calls have finished; rethrows the first exception thrown by any call.
+// (safe to call from inside another parallel_for -- the calling thread always helps)
+void parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn);
+
+//number of threads (workers + caller) that parallel_for spreads work over:
+uint32_t thread_count();
+
+} //namespace Jobs
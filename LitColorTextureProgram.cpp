@@ -1,5 +1,6 @@
 #include "LitColorTextureProgram.hpp"
 
+#include "Mesh.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
@@ -8,20 +9,12 @@ Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
 Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
 	LitColorTextureProgram *ret = new LitColorTextureProgram();
 
-	//----- build the pipeline template -----
-	lit_color_texture_program_pipeline.program = ret->program;
+	//----- build the pipeline template (and its material) -----
+	Material &material = Material::make();
+	material.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	//per-object matrices come from the Objects uniform block (and lighting from the Frame block -- see LitColorTextureProgram::FrameLight):
+	material.object_block = true;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -37,44 +30,65 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 
-	lit_color_texture_program_pipeline.textures[0].texture = tex;
-	lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
+	material.textures[0].texture = tex;
+	material.textures[0].target = GL_TEXTURE_2D;
+
+	lit_color_texture_program_pipeline.material = Material::handle(material);
 
 	return ret;
 });
 
 LitColorTextureProgram::LitColorTextureProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
+	//uniform blocks filled in by Scene::draw (see Scene::FrameData, FrameLight, and Scene::ObjectData):
+	std::string blocks =
+		"layout(std140) uniform Frame {\n"
+		"	mat4 WORLD_TO_CLIP;\n"
+		"	mat4x3 WORLD_TO_LIGHT;\n"
+		"	int LIGHT_TYPE;\n"
+		"	vec3 LIGHT_LOCATION;\n"
+		"	vec3 LIGHT_DIRECTION;\n"
+		"	vec3 LIGHT_ENERGY;\n"
+		"	float LIGHT_CUTOFF;\n"
+		"};\n"
+		"struct Object {\n"
+		"	mat4 OBJECT_TO_CLIP;\n"
+		"	mat4x3 OBJECT_TO_LIGHT;\n"
+		"	mat3 NORMAL_TO_LIGHT;\n"
+		"};\n"
+		"layout(std140) uniform Objects {\n"
+		"	Object OBJECTS[" + std::to_string(Scene::MaxObjects) + "];\n"
+		"};\n"
+	;
+
+	std::string vertex_shader =
 		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		+ blocks +
 		"in vec4 Position;\n"
-		"in vec3 Normal;\n"
+		"in vec4 Normal;\n"
 		"in vec4 Color;\n"
 		"in vec2 TexCoord;\n"
 		"out vec3 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"invariant gl_Position;\n" //(computed exactly as in DepthProgram, so a depth pre-pass and this agree)
+		//(quantized meshes store normals octahedral-encoded; see MeshBuffer::LayoutQuantized)
+		+ std::string(MeshBuffer::DecodeNormalGLSL) +
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		//(instanced draws draw several objects at once, each with its own matrices)
+		"	Object object = OBJECTS[gl_InstanceID];\n"
+		"	gl_Position = object.OBJECT_TO_CLIP * Position;\n"
+		"	position = object.OBJECT_TO_LIGHT * Position;\n"
+		"	normal = object.NORMAL_TO_LIGHT * decode_normal(Normal);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
-	,
-		//fragment shader:
+	;
+
+	std::string fragment_shader =
 		"#version 330\n"
+		+ blocks +
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
@@ -105,27 +119,22 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
 		"}\n"
-	);
+	;
 	//As you can see above, adjacent strings in C/C++ are concatenated.
 	// this is very useful for writing long shader programs inline.
 
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(vertex_shader, fragment_shader);
+
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
-	Normal_vec3 = glGetAttribLocation(program, "Normal");
+	Normal_vec4 = glGetAttribLocation(program, "Normal");
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
-	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
-
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
-
+	//point the uniform blocks at the buffers Scene::draw binds:
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Frame"), Scene::FrameBinding);
+	glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Objects"), Scene::ObjectsBinding);
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
 
@@ -13,22 +13,33 @@ struct LitColorTextureProgram {
 
 	//Attribute (per-vertex variable) locations:
 	GLuint Position_vec4 = -1U;
-	GLuint Normal_vec3 = -1U;
+	GLuint Normal_vec4 = -1U;
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
-	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
-
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
-	
+	//Uniform blocks (filled in by Scene::draw):
+	//Frame - camera (Scene::FrameData), then lighting (FrameLight, below, from Scene::frame_payload)
+	//Objects - per-object matrices (Scene::ObjectData), indexed by gl_InstanceID
+
+	//lighting, laid out to match the end of the Frame block:
+	// (scene.set_frame_payload(light) to light the scene's next draw; if no payload is set, the block reads zeros -- so no light)
+	struct FrameLight {
+		enum Type : int32_t {
+			Point = 0,
+			Hemisphere = 1,
+			Spot = 2,
+			Directional = 3
+		} type = Hemisphere;
+		float _pad0[3] = {0.0f, 0.0f, 0.0f};
+		glm::vec3 location = glm::vec3(0.0f); //(world space)
+		float _pad1 = 0.0f;
+		glm::vec3 direction = glm::vec3(0.0f, 0.0f,-1.0f); //(world space)
+		float _pad2 = 0.0f;
+		glm::vec3 energy = glm::vec3(1.0f);
+		float cutoff = 1.0f; //cosine of spotlight cone half-angle (packs in after energy)
+	};
+	static_assert(sizeof(FrameLight) == 64, "FrameLight matches std140 layout.");
+
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
 };
@@ -36,5 +47,6 @@ struct LitColorTextureProgram {
 extern Load< LitColorTextureProgram > lit_color_texture_program;
 
 //For convenient scene-graph setup, copy this object:
-// NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: its material has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+//  (for other textures, make a copy of the material -- Material::make(*Material::get(pipeline.material)) -- and change that)
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
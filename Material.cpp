@@ -0,0 +1,109 @@
+#include "Material.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	//The pool is made on first use and never freed: drawables everywhere hold Material::Handles
+	// (some in globals, like depth_program_material), and Material::get must work whenever one is
+	// looked up -- including from another file's global constructors or destructors, which may run
+	// before this file's globals are built or after they are gone.
+	Pool< Material > &materials() {
+		static Pool< Material > *materials = new Pool< Material >;
+		return *materials;
+	}
+}
+
+Material &Material::make() {
+	return materials().emplace();
+}
+
+Material &Material::make(Material const &from) {
+	return materials().emplace(from);
+}
+
+Material::Handle Material::handle(Material const &material) {
+	return materials().handle(material);
+}
+
+Material *Material::get(Handle const &handle) {
+	return materials().get(handle);
+}
+
+void Material::erase(Handle const &handle) {
+	materials().erase(handle);
+}
+
+Material::Uniform *Material::entry(GLuint location, UniformType type, uint32_t count) {
+	if (location == -1U) return nullptr;
+	for (auto &u : uniforms) {
+		if (u.location != GLint(location)) continue;
+		if (u.type != type) {
+			throw std::runtime_error("Material uniform at location " + std::to_string(location) + " set with a different type than before.");
+		}
+		return &u;
+	}
+	uniforms.emplace_back();
+	Uniform &u = uniforms.back();
+	u.location = GLint(location);
+	u.type = type;
+	if (type == UniformType::Int) {
+		u.offset = uint32_t(int_values.size());
+		int_values.resize(int_values.size() + count, 0);
+	} else {
+		u.offset = uint32_t(values.size());
+		values.resize(values.size() + count, 0.0f);
+	}
+	return &u;
+}
+
+void Material::set(GLuint location, int32_t value) {
+	if (Uniform *u = entry(location, UniformType::Int, 1)) int_values[u->offset] = value;
+}
+
+void Material::set(GLuint location, float value) {
+	if (Uniform *u = entry(location, UniformType::Float, 1)) values[u->offset] = value;
+}
+
+void Material::set(GLuint location, glm::vec2 const &value) {
+	if (Uniform *u = entry(location, UniformType::Vec2, 2)) std::copy(glm::value_ptr(value), glm::value_ptr(value) + 2, &values[u->offset]);
+}
+
+void Material::set(GLuint location, glm::vec3 const &value) {
+	if (Uniform *u = entry(location, UniformType::Vec3, 3)) std::copy(glm::value_ptr(value), glm::value_ptr(value) + 3, &values[u->offset]);
+}
+
+void Material::set(GLuint location, glm::vec4 const &value) {
+	if (Uniform *u = entry(location, UniformType::Vec4, 4)) std::copy(glm::value_ptr(value), glm::value_ptr(value) + 4, &values[u->offset]);
+}
+
+void Material::set(GLuint location, glm::mat3 const &value) {
+	if (Uniform *u = entry(location, UniformType::Mat3, 9)) std::copy(glm::value_ptr(value), glm::value_ptr(value) + 9, &values[u->offset]);
+}
+
+void Material::set(GLuint location, glm::mat4 const &value) {
+	if (Uniform *u = entry(location, UniformType::Mat4, 16)) std::copy(glm::value_ptr(value), glm::value_ptr(value) + 16, &values[u->offset]);
+}
+
+void Material::clear_uniforms() {
+	uniforms.clear();
+	values.clear();
+	int_values.clear();
+}
+
+void Material::apply() const {
+	for (auto const &u : uniforms) {
+		switch (u.type) {
+			case UniformType::Int: glUniform1iv(u.location, 1, &int_values[u.offset]); break;
+			case UniformType::Float: glUniform1fv(u.location, 1, &values[u.offset]); break;
+			case UniformType::Vec2: glUniform2fv(u.location, 1, &values[u.offset]); break;
+			case UniformType::Vec3: glUniform3fv(u.location, 1, &values[u.offset]); break;
+			case UniformType::Vec4: glUniform4fv(u.location, 1, &values[u.offset]); break;
+			case UniformType::Mat3: glUniformMatrix3fv(u.location, 1, GL_FALSE, &values[u.offset]); break;
+			case UniformType::Mat4: glUniformMatrix4fv(u.location, 1, GL_FALSE, &values[u.offset]); break;
+		}
+	}
+}
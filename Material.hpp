@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+ * A "Material" is the drawing state that many drawables share: a shader
+ *  program, the textures it reads, and values for its uniforms.
+ *
+ * Materials live in one shared pool (see Pool.hpp), and drawables refer to
+ *  them by handle (Scene::Drawable::Pipeline::material). So drawables stay
+ *  small, and Scene::draw can sort drawables by material and only re-apply
+ *  state when the material changes:
+ *
+ *   Material &material = Material::make();
+ *   material.program = some_program->program;
+ *   material.textures[0].texture = tex;
+ *   material.set(some_program->TINT_vec4, glm::vec4(1.0f, 0.5f, 0.5f, 1.0f));
+ *   drawable.pipeline.material = Material::handle(material);
+ *
+ * Uniform values are stored compactly as they are set -- a list of
+ *  (location, type, offset) entries over one array of values -- and apply()
+ *  sends them with one glUniform* call each. (Not a uniform buffer range per
+ *  material: the programs here declare their material values as plain
+ *  uniforms, and apply() only runs when the material changes.)
+ *
+ * Make, change, and erase materials from the main thread, not during a draw
+ *  (drawing reads them from several threads).
+ */
+
+#include "GL.hpp"
+#include "Pool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct Material {
+	typedef PoolHandle Handle; //(same as Pool< Material >::Handle)
+
+	//--- the shared pool of materials ---
+
+	//add a material (default, or a copy of 'from') to the pool:
+	static Material &make();
+	static Material &make(Material const &from);
+	//handle for a material in the pool:
+	static Handle handle(Material const &material);
+	//material for a handle, or nullptr if it has been erased:
+	// (drawables with such a handle are skipped when drawing)
+	static Material *get(Handle const &handle);
+	static void erase(Handle const &handle);
+
+	//--- state ---
+
+	GLuint program = 0; //shader program; passed to glUseProgram
+
+	//uniform locations for per-object matrices, which Scene::draw sets for each drawable:
+	// (not needed if the program reads these matrices from the "Objects" uniform block -- see object_block, below)
+	GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
+	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
+	GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
+
+	//set if 'program' reads the three matrices above from OBJECTS[gl_InstanceID] in the "Objects" uniform block (see Scene::ObjectData):
+	// Scene::draw then binds each draw's range of a streamed buffer in place of setting uniforms,
+	// and draws drawables that share a material, vertex array, and draw range with one instanced call
+	bool object_block = false;
+
+	//texture objects to bind for the first TextureCount texture units:
+	enum : uint32_t { TextureCount = 4 };
+	struct TextureInfo {
+		GLuint texture = 0;
+		GLenum target = GL_TEXTURE_2D;
+	} textures[TextureCount];
+
+	//uniform values, set by apply():
+	// a location of -1U is ignored (as glUniform* would); setting a location again replaces its value
+	// note: will throw if a location is set again with a different type
+	void set(GLuint location, int32_t value);
+	void set(GLuint location, float value);
+	void set(GLuint location, glm::vec2 const &value);
+	void set(GLuint location, glm::vec3 const &value);
+	void set(GLuint location, glm::vec4 const &value);
+	void set(GLuint location, glm::mat3 const &value);
+	void set(GLuint location, glm::mat4 const &value);
+	void clear_uniforms();
+
+	//set uniform values (program must be bound):
+	void apply() const;
+
+	//--- storage for uniform values ---
+	enum class UniformType : uint8_t { Int, Float, Vec2, Vec3, Vec4, Mat3, Mat4 };
+	struct Uniform {
+		GLint location = -1;
+		UniformType type = UniformType::Float;
+		uint32_t offset = 0; //first entry in 'values' (or 'int_values' for Int)
+	};
+	std::vector< Uniform > uniforms;
+	std::vector< float > values;
+	std::vector< int32_t > int_values;
+
+private:
+	//find or add the entry for location, with room for 'count' values:
+	Uniform *entry(GLuint location, UniformType type, uint32_t count);
+};
@@ -1,23 +1,29 @@
 #include "Mesh.hpp"
-#include "read_write_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "MeshBVH.hpp"
+#include "Jobs.hpp"
+#include "simd.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <memory>
+#include <future>
+#include <exception>
+#include <chrono>
 #include <cstddef>
+#include <cstring>
+#include <cmath>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
-
-	std::ifstream file(filename, std::ios::binary);
-
-	GLuint total = 0;
-
+namespace {
+	//vertex layout in '.pnct' and '.pnci' files:
 	struct Vertex {
 		glm::vec3 Position;
 		glm::vec3 Normal;
@@ -25,40 +31,246 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	//expand min/max to contain the positions of vertices [begin,end):
+	void position_bounds(Vertex const *begin, Vertex const *end, glm::vec3 *min, glm::vec3 *max) {
+		#if defined(HAVE_SSE)
+		//Position is followed by Normal, so four floats can be loaded at once (the fourth is ignored):
+		__m128 lo = _mm_set_ps(0.0f, min->z, min->y, min->x);
+		__m128 hi = _mm_set_ps(0.0f, max->z, max->y, max->x);
+		for (Vertex const *v = begin; v != end; ++v) {
+			__m128 p = _mm_loadu_ps(&v->Position.x);
+			lo = _mm_min_ps(lo, p);
+			hi = _mm_max_ps(hi, p);
+		}
+		float out[4];
+		_mm_storeu_ps(out, lo);
+		*min = glm::vec3(out[0], out[1], out[2]);
+		_mm_storeu_ps(out, hi);
+		*max = glm::vec3(out[0], out[1], out[2]);
+		#else
+		for (Vertex const *v = begin; v != end; ++v) {
+			*min = glm::min(*min, v->Position);
+			*max = glm::max(*max, v->Position);
+		}
+		#endif
+	}
+}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+//helpers for MeshBuffer::LayoutQuantized:
+namespace {
+	struct QuantizedVertex {
+		glm::i16vec4 Position;
+		uint32_t Normal;
+		glm::u8vec4 Color;
+		uint32_t TexCoord;
+	};
+	static_assert(sizeof(QuantizedVertex) == 4*2+4+4*1+2*2, "QuantizedVertex is packed.");
+
+	//value in [-1,1] to signed normalized integer with the given number of bits:
+	int32_t quantize_snorm(float value, uint32_t bits) {
+		float max = float((1 << (bits - 1)) - 1);
+		return int32_t(std::round(std::max(-1.0f, std::min(1.0f, value)) * max));
+	}
+
+	//normal to octahedral encoding, packed into x,y of a GL_INT_2_10_10_10_REV with w = -1:
+	uint32_t quantize_normal(glm::vec3 n) {
+		float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (l1 == 0.0f) n = glm::vec3(0.0f, 0.0f, 1.0f);
+		else n /= l1;
+		glm::vec2 o = glm::vec2(n.x, n.y);
+		if (n.z < 0.0f) {
+			o = glm::vec2(
+				(1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+				(1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)
+			);
+		}
+		uint32_t x = uint32_t(quantize_snorm(o.x, 10)) & 0x3ff;
+		uint32_t y = uint32_t(quantize_snorm(o.y, 10)) & 0x3ff;
+		uint32_t w = uint32_t(-2) & 0x3; //(-2 is -1.0 under both the GL 3.3 and 4.2+ snorm conversion rules)
+		return x | (y << 10) | (w << 30);
+	}
+}
+
+//data read by MeshBuffer::parse() and waiting for MeshBuffer::upload():
+struct MeshBuffer::Staging {
+	std::unique_ptr< ChunkFile > file; //(vertices and indices may point into the file's mapping)
+	std::vector< char > vertex_copy; //(used for vertices that had to be converted)
+	std::vector< char > position_copy; //(used for split-out positions)
+
+	char const *vertex_data = nullptr;
+	size_t vertex_bytes = 0;
+	size_t vertex_uploaded = 0;
+
+	char const *position_data = nullptr;
+	size_t position_bytes = 0;
+	size_t position_uploaded = 0;
+
+	bool indexed = false;
+	char const *index_data = nullptr;
+	size_t index_bytes = 0;
+	size_t index_uploaded = 0;
+};
+
+//shared between a Pending handle and its worker thread:
+struct MeshBuffer::Pending::State {
+	std::unique_ptr< MeshBuffer > buffer;
+	Staging staging;
+	bool parsed = false; //set once 'worker' has been waited on
+	std::exception_ptr error; //exception from parse(), if any (rethrown by every later poll() or wait())
+	bool done = false; //set once everything has been uploaded
+	std::future< void > worker; //(declared last, so it is waited on before anything else is destroyed)
+
+	//wait for parse() to finish, then rethrow its exception (every time) if it had one:
+	void finish_parse() {
+		if (!parsed) {
+			try {
+				worker.get();
+			} catch (...) {
+				error = std::current_exception();
+			}
+			parsed = true;
+		}
+		if (error) std::rethrow_exception(error);
+	}
+};
+
+MeshBuffer::Pending MeshBuffer::load_async(std::string const &filename, Layout layout, bool build_bvhs, Streams streams) {
+	Pending pending;
+	pending.state = std::make_shared< Pending::State >();
+	Pending::State *state = pending.state.get();
+	state->buffer.reset(new MeshBuffer());
+	state->buffer->layout = layout;
+	state->buffer->streams = streams;
+	state->worker = std::async(std::launch::async, [state, filename, build_bvhs]() {
+		state->buffer->parse(filename, build_bvhs, &state->staging);
+	});
+	return pending;
+}
+
+bool MeshBuffer::Pending::poll(float max_seconds) {
+	assert(state && "poll() called on an empty Pending");
+	if (state->done) return true;
+	if (!state->parsed) {
+		if (state->worker.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+	}
+	state->finish_parse(); //(rethrows any exception from parse())
+
+	constexpr size_t PieceBytes = 1 << 20;
+	auto before = std::chrono::high_resolution_clock::now();
+	while (!state->buffer->upload(&state->staging, PieceBytes)) {
+		if (std::chrono::duration< float >(std::chrono::high_resolution_clock::now() - before).count() >= max_seconds) return false;
+	}
+	state->done = true;
+	return true;
+}
+
+MeshBuffer const *MeshBuffer::Pending::wait() {
+	assert(state && "wait() called on an empty Pending");
+	state->finish_parse();
+	while (!state->done) {
+		state->done = state->buffer->upload(&state->staging, std::numeric_limits< size_t >::max());
+	}
+	return state->buffer.release();
+}
+
+MeshBuffer::MeshBuffer(std::string const &filename, Layout layout_, bool build_bvhs, Streams streams_) : layout(layout_), streams(streams_) {
+	Staging staging;
+	parse(filename, build_bvhs, &staging);
+	while (!upload(&staging, std::numeric_limits< size_t >::max())) { }
+}
+
+void MeshBuffer::parse(std::string const &filename, bool build_bvhs, Staging *staging) {
+	//chunks are read directly from the mapped file (no intermediate copies):
+	// (the file stays open in 'staging' so vertices and indices can be uploaded straight from it)
+	staging->file = std::make_unique< ChunkFile >(filename);
+	ChunkFile &file = *staging->file;
+
+	GLuint total = 0;
+	ChunkFile::Chunk vertices;
 
-		total = GLuint(data.size()); //store total for later checks on index
+	//'.pnci' files also have an index chunk:
+	bool indexed = false;
+
+	//locate data chunk (it is read after the index):
+	if (filename.size() >= 5 && (filename.substr(filename.size()-5) == ".pnct" || filename.substr(filename.size()-5) == ".pnci")) {
+		indexed = (filename.substr(filename.size()-5) == ".pnci");
+		vertices = file.skip("pnct");
+
+		uint64_t bytes = file.data_size(vertices);
+		if (bytes % sizeof(Vertex) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		if (bytes / sizeof(Vertex) > std::numeric_limits< GLuint >::max()) {
+			throw std::runtime_error("Mesh file '" + filename + "' has too many vertices.");
+		}
+		total = GLuint(bytes / sizeof(Vertex)); //store total for later checks on index
 
 		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+		if (layout == LayoutQuantized) {
+			Position = Attrib(4, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position));
+			Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Color));
+			TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoord));
+		} else {
+			Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+			Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+			TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+		}
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//indices (for indexed files) are either 16 or 32 bits:
+	ChunkFile::Span< uint16_t > indices16;
+	ChunkFile::Span< uint32_t > indices32;
+	GLenum index_type = GL_NONE;
+	if (indexed) {
+		ChunkFile::Chunk chunk;
+		if (file.find("ix16", &chunk)) {
+			indices16 = file.read< uint16_t >(chunk);
+			index_type = GL_UNSIGNED_SHORT;
+		} else if (file.find("ix32", &chunk)) {
+			indices32 = file.read< uint32_t >(chunk);
+			index_type = GL_UNSIGNED_INT;
+		} else {
+			throw std::runtime_error("Mesh file '" + filename + "' has no index chunk.");
+		}
+		file.seek_past(chunk);
+	}
+	size_t index_count = (index_type == GL_UNSIGNED_SHORT ? indices16.size() : indices32.size());
+	if (index_count > std::numeric_limits< GLuint >::max()) {
+		throw std::runtime_error("Mesh file '" + filename + "' has too many indices.");
+	}
+
+	ChunkFile::Span< char > strings = file.read< char >("str0");
+
+	//meshes (and their vertex ranges) whose bounds are computed once vertex data is read:
+	struct Loaded {
+		Mesh *mesh;
+		GLuint vertex_begin, vertex_end;
+	};
+	std::vector< Loaded > loaded;
 
-	{ //read index chunk, add to meshes:
+	//add a mesh (after its ranges have been checked):
+	auto add_mesh = [&](Name const &name, Mesh const &mesh, GLuint vertex_begin, GLuint vertex_end) {
+		auto ret = meshes.insert(std::make_pair(name, mesh));
+		if (!ret.second) {
+			std::cerr << "WARNING: mesh name '" + name.str() + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		} else {
+			loaded.emplace_back(Loaded{&ret.first->second, vertex_begin, vertex_end});
+		}
+	};
+
+	if (!indexed) { //read index chunk, add to meshes:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		ChunkFile::Span< IndexEntry > index = file.read< IndexEntry >("idx0");
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -67,67 +279,331 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			Name name(std::string_view(strings.data() + entry.name_begin, entry.name_end - entry.name_begin));
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			add_mesh(name, mesh, entry.vertex_begin, entry.vertex_end);
+		}
+	} else { //read indexed-mesh index chunk, add to meshes:
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+			uint32_t index_begin, index_end; //indices are relative to vertex_begin
+		};
+		static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+
+		ChunkFile::Span< IndexEntry > index = file.read< IndexEntry >("idx1");
+
+		for (auto const &entry : index) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (!(entry.index_begin <= entry.index_end && entry.index_end <= index_count)) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
+			}
+			if (entry.vertex_begin > GLuint(std::numeric_limits< GLint >::max())) {
+				throw std::runtime_error("index entry has out-of-range vertex start");
+			}
+			//make sure indices stay within the mesh's vertices:
+			uint32_t vertex_count = entry.vertex_end - entry.vertex_begin;
+			for (uint32_t i = entry.index_begin; i < entry.index_end; ++i) {
+				uint32_t v = (index_type == GL_UNSIGNED_SHORT ? indices16[i] : indices32[i]);
+				if (v >= vertex_count) {
+					throw std::runtime_error("index entry has out-of-range vertex index");
+				}
+			}
+			Name name(std::string_view(strings.data() + entry.name_begin, entry.name_end - entry.name_begin));
+			Mesh mesh;
+			mesh.type = GL_TRIANGLES;
+			mesh.start = entry.index_begin;
+			mesh.count = entry.index_end - entry.index_begin;
+			mesh.index_type = index_type;
+			mesh.base_vertex = GLint(entry.vertex_begin);
+			add_mesh(name, mesh, entry.vertex_begin, entry.vertex_end);
+		}
+	}
+
+	if (indexed) { //indices are uploaded as-is:
+		staging->indexed = true;
+		if (index_type == GL_UNSIGNED_SHORT) {
+			staging->index_data = reinterpret_cast< char const * >(indices16.data());
+			staging->index_bytes = indices16.size() * sizeof(uint16_t);
+		} else {
+			staging->index_data = reinterpret_cast< char const * >(indices32.data());
+			staging->index_bytes = indices32.size() * sizeof(uint32_t);
+		}
+	}
+
+	//(compressed vertex chunks are inflated here; plain ones are used in place)
+	ChunkFile::Span< Vertex > all = file.read< Vertex >(vertices);
+	assert(all.size() == total);
+
+	{ //compute mesh bounds (once per distinct vertex range, in parallel):
+		std::vector< std::pair< GLuint, GLuint > > ranges;
+		for (Loaded const &l : loaded) {
+			ranges.emplace_back(l.vertex_begin, l.vertex_end);
+		}
+		std::sort(ranges.begin(), ranges.end());
+		ranges.erase(std::unique(ranges.begin(), ranges.end()), ranges.end());
+
+		std::vector< glm::vec3 > mins(ranges.size(), glm::vec3( std::numeric_limits< float >::infinity()));
+		std::vector< glm::vec3 > maxs(ranges.size(), glm::vec3(-std::numeric_limits< float >::infinity()));
+		Jobs::parallel_for(uint32_t(ranges.size()), [&](uint32_t r) {
+			position_bounds(all.data() + ranges[r].first, all.data() + ranges[r].second, &mins[r], &maxs[r]);
+		});
+
+		for (Loaded const &l : loaded) {
+			size_t r = std::lower_bound(ranges.begin(), ranges.end(), std::make_pair(l.vertex_begin, l.vertex_end)) - ranges.begin();
+			l.mesh->min = mins[r];
+			l.mesh->max = maxs[r];
+		}
+	}
+
+	if (layout == LayoutFull) { //vertices are uploaded as-is:
+		staging->vertex_data = reinterpret_cast< char const * >(all.data());
+		staging->vertex_bytes = all.size() * sizeof(Vertex);
+	} else { //quantize relative to mesh bounds:
+		assert(layout == LayoutQuantized);
+
+		//meshes with overlapping vertex ranges must share an encoding, so group them:
+		struct Group {
+			GLuint vertex_begin, vertex_end;
+			glm::vec3 min, max;
+			glm::vec3 offset, inv_scale;
+		};
+		std::vector< Group > groups;
+		{
+			std::vector< Loaded > sorted = loaded;
+			std::sort(sorted.begin(), sorted.end(), [](Loaded const &a, Loaded const &b) {
+				return a.vertex_begin < b.vertex_begin;
+			});
+			std::vector< std::vector< Mesh * > > members;
+			for (Loaded const &l : sorted) {
+				if (l.vertex_begin == l.vertex_end) continue;
+				if (groups.empty() || l.vertex_begin >= groups.back().vertex_end) {
+					groups.emplace_back(Group{l.vertex_begin, l.vertex_end, l.mesh->min, l.mesh->max, glm::vec3(0.0f), glm::vec3(0.0f)});
+					members.emplace_back();
+				} else {
+					groups.back().vertex_end = std::max(groups.back().vertex_end, l.vertex_end);
+					groups.back().min = glm::min(groups.back().min, l.mesh->min);
+					groups.back().max = glm::max(groups.back().max, l.mesh->max);
+				}
+				members.back().emplace_back(l.mesh);
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			for (size_t i = 0; i < groups.size(); ++i) {
+				Group &group = groups[i];
+				group.offset = 0.5f * (group.max + group.min);
+				glm::vec3 scale = 0.5f * (group.max - group.min);
+				for (uint32_t c = 0; c < 3; ++c) {
+					group.inv_scale[c] = (scale[c] > 0.0f ? 1.0f / scale[c] : 0.0f);
+				}
+				for (Mesh *mesh : members[i]) {
+					mesh->position_offset = group.offset;
+					mesh->position_scale = scale;
+				}
 			}
 		}
+
+		staging->vertex_copy.resize(size_t(total) * sizeof(QuantizedVertex));
+		QuantizedVertex *quantized = reinterpret_cast< QuantizedVertex * >(staging->vertex_copy.data());
+		size_t g = 0; //(groups are sorted, so the current group only moves forward)
+		for (size_t v = 0; v < all.size(); ++v) {
+			while (g < groups.size() && groups[g].vertex_end <= v) ++g;
+			Vertex const &in = all[v];
+			QuantizedVertex &out = quantized[v];
+
+			//(vertices that aren't part of any mesh are never drawn)
+			glm::vec3 p = glm::vec3(0.0f);
+			if (g < groups.size() && groups[g].vertex_begin <= v) {
+				p = (in.Position - groups[g].offset) * groups[g].inv_scale;
+			}
+			out.Position = glm::i16vec4(
+				quantize_snorm(p.x, 16), quantize_snorm(p.y, 16), quantize_snorm(p.z, 16),
+				quantize_snorm(1.0f, 16)
+			);
+			out.Normal = quantize_normal(in.Normal);
+			out.Color = in.Color;
+			out.TexCoord = glm::packHalf2x16(in.TexCoord);
+		}
+		staging->vertex_data = staging->vertex_copy.data();
+		staging->vertex_bytes = staging->vertex_copy.size();
+	}
+
+	if (streams == StreamsSplitPositions) { //move positions (which lead each vertex) to a stream of their own:
+		GLsizei stride = Position.stride;
+		GLsizei position_size = (layout == LayoutQuantized ? sizeof(glm::i16vec4) : sizeof(glm::vec3));
+		assert(Position.offset == 0);
+		size_t count = staging->vertex_bytes / stride;
+		std::vector< char > positions(count * position_size);
+		std::vector< char > attributes(count * (stride - position_size));
+		for (size_t v = 0; v < count; ++v) {
+			char const *in = staging->vertex_data + v * stride;
+			std::memcpy(positions.data() + v * position_size, in, position_size);
+			std::memcpy(attributes.data() + v * (stride - position_size), in + position_size, stride - position_size);
+		}
+		staging->position_copy = std::move(positions);
+		staging->position_data = staging->position_copy.data();
+		staging->position_bytes = staging->position_copy.size();
+		staging->vertex_copy = std::move(attributes);
+		staging->vertex_data = staging->vertex_copy.data();
+		staging->vertex_bytes = staging->vertex_copy.size();
+
+		Position.stride = position_size;
+		for (Attrib *attrib : {&Normal, &Color, &TexCoord}) {
+			attrib->stride -= position_size;
+			attrib->offset -= position_size;
+		}
 	}
 
-	if (file.peek() != EOF) {
+	if (build_bvhs) { //build a triangle hierarchy for each distinct range of triangles, in parallel:
+		//(vertex begin, first, count) -> meshes drawing those triangles:
+		std::map< std::tuple< GLuint, GLuint, GLuint >, std::vector< Mesh * > > ranges;
+		for (Loaded const &l : loaded) {
+			if (l.mesh->type != GL_TRIANGLES) continue;
+			ranges[std::make_tuple(l.vertex_begin, l.mesh->start, l.mesh->count)].emplace_back(l.mesh);
+		}
+		std::vector< std::pair< std::tuple< GLuint, GLuint, GLuint >, std::vector< Mesh * > > > work(ranges.begin(), ranges.end());
+
+		Jobs::parallel_for(uint32_t(work.size()), [&](uint32_t w) {
+			auto [vertex_begin, first, count] = work[w].first;
+			std::vector< glm::vec3 > triangles;
+			triangles.reserve(count - count % 3);
+			for (GLuint i = first; i < first + count - count % 3; ++i) {
+				if (index_type == GL_NONE) triangles.emplace_back(all[i].Position);
+				else if (index_type == GL_UNSIGNED_SHORT) triangles.emplace_back(all[vertex_begin + indices16[i]].Position);
+				else triangles.emplace_back(all[vertex_begin + indices32[i]].Position);
+			}
+			std::shared_ptr< MeshBVH const > bvh = std::make_shared< MeshBVH >(triangles);
+			for (Mesh *mesh : work[w].second) {
+				mesh->bvh = bvh;
+			}
+		});
+	}
+
+	if (!file.at_end()) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
+	//gather levels of detail ("<name>@lod<level>") into the meshes they simplify:
+	// (copied, so done after bounds and encodings are final)
+	for (auto &[name, mesh] : meshes) {
+		std::vector< Mesh > &lods = mesh.lods;
+		for (uint32_t level = 1; ; ++level) {
+			Name lod_name = Name::find(name.str() + "@lod" + std::to_string(level));
+			if (lod_name.empty()) break;
+			auto f = meshes.find(lod_name);
+			if (f == meshes.end()) break;
+			lods.emplace_back(f->second);
+		}
+	}
+
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
 	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+		std::cout << " '" << m.first.str() << "'";
 	}
 	std::cout << std::endl;
 	*/
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
+bool MeshBuffer::upload(Staging *staging, size_t max_bytes) {
+	//(element array bindings are part of vao state, so upload through the array buffer binding point instead)
+	if (buffer == 0) {
+		buffer_size = staging->vertex_bytes;
+		position_buffer_size = staging->position_bytes;
+		index_buffer_size = staging->index_bytes;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(staging->vertex_bytes), nullptr, GL_STATIC_DRAW);
+		if (streams == StreamsSplitPositions) {
+			glGenBuffers(1, &position_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
+			glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(staging->position_bytes), nullptr, GL_STATIC_DRAW);
+		}
+		if (staging->indexed) {
+			glGenBuffers(1, &index_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+			glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(staging->index_bytes), nullptr, GL_STATIC_DRAW);
+		}
+	}
+
+	auto upload_part = [&](GLuint target, char const *data, size_t bytes, size_t *uploaded) {
+		size_t count = std::min(bytes - *uploaded, max_bytes);
+		if (count == 0) return;
+		glBindBuffer(GL_ARRAY_BUFFER, target);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(*uploaded), GLsizeiptr(count), data + *uploaded);
+		*uploaded += count;
+		max_bytes -= count;
+	};
+	upload_part(index_buffer, staging->index_data, staging->index_bytes, &staging->index_uploaded);
+	upload_part(position_buffer, staging->position_data, staging->position_bytes, &staging->position_uploaded);
+	upload_part(buffer, staging->vertex_data, staging->vertex_bytes, &staging->vertex_uploaded);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (staging->index_uploaded < staging->index_bytes
+	 || staging->position_uploaded < staging->position_bytes
+	 || staging->vertex_uploaded < staging->vertex_bytes) return false;
+
+	//everything has been uploaded, so the file can be closed:
+	staging->file.reset();
+	staging->vertex_copy.clear();
+	staging->position_copy.clear();
+	return true;
+}
+
+const Mesh &MeshBuffer::lookup(Name const &name) const {
 	auto f = meshes.find(name);
 	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
+		throw std::runtime_error("Looking up mesh '" + name.str() + "' that doesn't exist.");
 	}
 	return f->second;
 }
 
+const Mesh &MeshBuffer::lookup(std::string_view const &name) const {
+	Name found = Name::find(name);
+	if (found.empty() && !name.empty()) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return lookup(found);
+}
+
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+	if (arena) return arena->vao_for_program(program);
+
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
+	setup_vao(vao, program, buffer, position_buffer, index_buffer);
+	return vao;
+}
+
+void MeshBuffer::setup_vao(GLuint vao, GLuint program, GLuint vertex_buffer, GLuint position_vertex_buffer, GLuint element_buffer) const {
 	glBindVertexArray(vao);
 
 	//Try to bind all attributes in this buffer:
+	// (each from the stream it is stored in, so a position-only program never reads the attribute stream)
 	std::set< GLuint > bound;
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
+	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib, GLuint stream) {
 		if (attrib.size == 0) return; //don't bind empty attribs
 		GLint location = glGetAttribLocation(program, name);
 		if (location == -1) return; //can't bind missing attribs
+		glBindBuffer(GL_ARRAY_BUFFER, stream);
 		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
 		glEnableVertexAttribArray(location);
 		bound.insert(location);
 	};
-	bind_attribute("Position", Position);
-	bind_attribute("Normal", Normal);
-	bind_attribute("Color", Color);
-	bind_attribute("TexCoord", TexCoord);
+	bind_attribute("Position", Position, (streams == StreamsSplitPositions ? position_vertex_buffer : vertex_buffer));
+	bind_attribute("Normal", Normal, vertex_buffer);
+	bind_attribute("Color", Color, vertex_buffer);
+	bind_attribute("TexCoord", TexCoord, vertex_buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(the element array binding is stored in the vao)
+	if (element_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
 	glBindVertexArray(0);
 
 	//Check that all active attributes were bound:
@@ -145,6 +621,149 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
 		}
 	}
+}
+
+//-------------------------
+
+MeshArena::MeshArena(MeshBuffer::Layout layout_, MeshBuffer::Streams streams_) : layout(layout_), streams(streams_) {
+	format.layout = layout;
+	format.streams = streams;
+}
+
+MeshArena::~MeshArena() {
+	for (auto const &[program, vao] : vaos) {
+		glDeleteVertexArrays(1, &vao);
+	}
+	vaos.clear();
+	if (buffer) glDeleteBuffers(1, &buffer);
+	buffer = 0;
+	if (position_buffer) glDeleteBuffers(1, &position_buffer);
+	position_buffer = 0;
+	if (index_buffer) glDeleteBuffers(1, &index_buffer);
+	index_buffer = 0;
+}
+
+void MeshArena::add(MeshBuffer *source) {
+	assert(source);
+	if (source->arena) {
+		throw std::runtime_error("Adding a MeshBuffer to an arena when it is already in one.");
+	}
+	if (source->layout != layout) {
+		throw std::runtime_error("Adding a MeshBuffer to an arena with a different layout.");
+	}
+	if (source->streams != streams) {
+		throw std::runtime_error("Adding a MeshBuffer to an arena with different streams.");
+	}
+	if (buffer_used == 0 && index_buffer_used == 0) {
+		format.Position = source->Position;
+		format.Normal = source->Normal;
+		format.Color = source->Color;
+		format.TexCoord = source->TexCoord;
+	}
+	//(stride of 'buffer', which doesn't hold positions if streams are split)
+	GLsizei stride = (streams == MeshBuffer::StreamsSplitPositions ? format.Normal.stride : format.Position.stride);
+	assert(stride > 0 && buffer_used % stride == 0);
+
+	//indices are placed at 4-byte boundaries, so both 16- and 32-bit ranges start on an index:
+	size_t index_begin = (index_buffer_used + 3) & ~size_t(3);
+	size_t vertex_begin = buffer_used;
+	size_t position_begin = position_buffer_used;
+	reserve(vertex_begin + source->buffer_size, position_begin + source->position_buffer_size, index_begin + source->index_buffer_size);
+
+	//copy data (on the GPU):
+	if (source->buffer_size) {
+		glBindBuffer(GL_COPY_READ_BUFFER, source->buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, GLintptr(vertex_begin), GLsizeiptr(source->buffer_size));
+	}
+	if (source->position_buffer_size) {
+		glBindBuffer(GL_COPY_READ_BUFFER, source->position_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, position_buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, GLintptr(position_begin), GLsizeiptr(source->position_buffer_size));
+	}
+	if (source->index_buffer_size) {
+		glBindBuffer(GL_COPY_READ_BUFFER, source->index_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, GLintptr(index_begin), GLsizeiptr(source->index_buffer_size));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	buffer_used = vertex_begin + source->buffer_size;
+	position_buffer_used = position_begin + source->position_buffer_size;
+	if (source->index_buffer_size) index_buffer_used = index_begin + source->index_buffer_size;
+
+	//point meshes at the copies:
+	GLuint vertex_offset = GLuint(vertex_begin / stride);
+	auto relocate = [&](Mesh &mesh) {
+		if (mesh.index_type != GL_NONE) {
+			GLuint index_size = (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			mesh.start += GLuint(index_begin / index_size);
+			mesh.base_vertex += GLint(vertex_offset);
+		} else {
+			mesh.start += vertex_offset;
+		}
+	};
+	for (auto &[name, mesh] : source->meshes) {
+		relocate(mesh);
+		for (Mesh &lod : mesh.lods) {
+			relocate(lod);
+		}
+	}
+
+	glDeleteBuffers(1, &source->buffer);
+	source->buffer = 0;
+	if (source->position_buffer) glDeleteBuffers(1, &source->position_buffer);
+	source->position_buffer = 0;
+	if (source->index_buffer) glDeleteBuffers(1, &source->index_buffer);
+	source->index_buffer = 0;
+	source->arena = this;
+}
+
+void MeshArena::reserve(size_t vertex_bytes, size_t position_bytes, size_t index_bytes) {
+	bool changed = false;
+
+	//grow a buffer (by at least doubling, so a series of adds only copies each byte a few times):
+	auto grow = [&changed](GLuint *target, size_t used, size_t *capacity, size_t needed) {
+		if (needed <= *capacity && *target != 0) return;
+		size_t new_capacity = std::max(needed, 2 * *capacity);
+		GLuint new_target = 0;
+		glGenBuffers(1, &new_target);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, new_target);
+		glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(new_capacity), nullptr, GL_STATIC_DRAW);
+		if (*target) {
+			if (used) {
+				glBindBuffer(GL_COPY_READ_BUFFER, *target);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, GLsizeiptr(used));
+				glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			}
+			glDeleteBuffers(1, target);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		*target = new_target;
+		*capacity = new_capacity;
+		changed = true;
+	};
+	grow(&buffer, buffer_used, &buffer_capacity, vertex_bytes);
+	if (streams == MeshBuffer::StreamsSplitPositions) {
+		grow(&position_buffer, position_buffer_used, &position_buffer_capacity, position_bytes);
+	}
+	grow(&index_buffer, index_buffer_used, &index_buffer_capacity, index_bytes);
+
+	//vaos refer to buffers by name, so re-point them at the new ones:
+	if (changed) {
+		for (auto const &[program, vao] : vaos) {
+			format.setup_vao(vao, program, buffer, position_buffer, index_buffer);
+		}
+	}
+}
+
+GLuint MeshArena::vao_for_program(GLuint program) {
+	auto f = vaos.find(program);
+	if (f != vaos.end()) return f->second;
 
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	format.setup_vao(vao, program, buffer, position_buffer, index_buffer);
+	vaos.emplace(program, vao);
 	return vao;
 }
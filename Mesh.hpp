@@ -7,50 +7,165 @@
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
  *
+ * MeshBuffers can be loaded from two formats:
+ *  '.pnct' files (from export-meshes.py) store each mesh as unindexed triangles;
+ *  '.pnci' files (from index-meshes, see index-meshes.cpp) store each mesh as
+ *   deduplicated vertices plus 16- or 32-bit indices, which are drawn with glDrawElements.
+ *
+ * Meshes named "<name>@lod1", "<name>@lod2", ... are also gathered into the
+ *  Mesh::lods of mesh "<name>", so that Scene::draw can switch to them when
+ *  the mesh is small on screen.
+ *
+ * Either can be uploaded as-is (LayoutFull) or quantized to a compact layout
+ *  (LayoutQuantized); see MeshBuffer::Layout below.
+ *
+ * Several MeshBuffers can share one set of OpenGL buffers (and one vao per
+ *  program) by adding them to a MeshArena.
+ *
  */
 
 #include "GL.hpp"
+#include "Name.hpp"
 #include <glm/glm.hpp>
 #include <map>
+#include <unordered_map>
 #include <limits>
 #include <string>
+#include <vector>
+#include <memory>
 
+struct MeshBVH;
+struct MeshArena;
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or, for indexed meshes, of first index)
+	GLuint count = 0; //count of vertices (or, for indexed meshes, of indices)
+
+	//Indexed meshes are ranges of the MeshBuffer's index buffer:
+	GLenum index_type = GL_NONE; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT if mesh is indexed
+	GLint base_vertex = 0; //added to each index (indices are relative to the mesh's first vertex)
 
 	//Bounding box.
-	//useful for debug visualization and (perhaps, eventually) collision detection:
+	//useful for debug visualization and quick rejection tests:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Quantized meshes store positions relative to their bounds:
+	// position = position_offset + position_scale * (stored position)
+	glm::vec3 position_scale = glm::vec3(1.0f);
+	glm::vec3 position_offset = glm::vec3(0.0f);
+
+	//Levels of detail -- simplified versions of this mesh, from most to least detailed.
+	//These are the meshes named "<name>@lod1", "<name>@lod2", ... in the same file (see simplify-meshes.cpp):
+	std::vector< Mesh > lods;
+
+	//Triangle hierarchy for ray and overlap queries against the mesh's actual shape (see MeshBVH.hpp).
+	//only built if requested when the MeshBuffer is loaded:
+	std::shared_ptr< MeshBVH const > bvh;
 };
 
 struct MeshBuffer {
+	//vertex layout used in the OpenGL buffer:
+	enum Layout {
+		//36 bytes per vertex, exactly as stored in files:
+		// float3 Position, float3 Normal, u8x4 Color, float2 TexCoord
+		LayoutFull,
+		//20 bytes per vertex:
+		// snorm16x4 Position (relative to mesh bounds -- see Mesh::position_scale/offset; w is always 1)
+		// snorm 10:10:10:2 Normal (octahedral-encoded in x,y; w is -1 to mark the encoding)
+		// u8x4 Color, half2 TexCoord
+		//shaders should pass Normal through decode_normal() (see DecodeNormalGLSL)
+		LayoutQuantized,
+	};
+
+	//GLSL for 'vec3 decode_normal(vec4 n)', which turns a Normal attribute from either layout into a normal;
+	// paste it into vertex shaders ahead of main():
+	static constexpr char const *DecodeNormalGLSL =
+		"vec3 decode_normal(vec4 n) {\n"
+		"	if (n.w >= 0.0) return n.xyz;\n"
+		"	vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));\n"
+		"	if (v.z < 0.0) v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);\n"
+		"	return normalize(v);\n"
+		"}\n"
+	;
+
+	//how vertex data is divided between OpenGL buffers:
+	enum Streams {
+		//every attribute interleaved in 'buffer':
+		StreamsInterleaved,
+		//Position alone in 'position_buffer', the other attributes interleaved in 'buffer':
+		// programs that only read Position (depth pre-passes, shadow maps) then fetch 12 (quantized: 8) bytes per vertex
+		StreamsSplitPositions,
+	};
+
 	//construct from a file:
+	// if build_bvhs is set, also keeps a (CPU-side) MeshBVH of each mesh's triangles in Mesh::bvh
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	MeshBuffer(std::string const &filename, Layout layout = LayoutFull, bool build_bvhs = false, Streams streams = StreamsInterleaved);
+	Layout layout = LayoutFull;
+	Streams streams = StreamsInterleaved;
+
+	//load from a file in the background:
+	// reading, bounds, quantization, and BVHs are computed on a worker thread;
+	// the handle's poll() or wait() (which must be called on the thread with the OpenGL context) then uploads the data a piece at a time.
+	struct Pending {
+		//upload for at most (about) max_seconds; returns true once the buffer is ready:
+		// note: will throw if the file failed to read (and again on every later call).
+		bool poll(float max_seconds = 0.002f);
+		//wait for the worker, finish uploading, and return the buffer (the caller owns it, as with 'new MeshBuffer'):
+		// note: will throw if the file failed to read.
+		MeshBuffer const *wait();
+
+		struct State;
+		std::shared_ptr< State > state;
+	};
+	static Pending load_async(std::string const &filename, Layout layout = LayoutFull, bool build_bvhs = false, Streams streams = StreamsInterleaved);
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
+	// (names are interned, so this is a hash lookup on an id -- see Name.hpp)
+	const Mesh &lookup(Name const &name) const;
+	// (by string: doesn't add the string to the name table if no mesh has that name)
+	const Mesh &lookup(std::string_view const &name) const;
 	
 	//build a vertex array object that links this vbo to attributes to a program:
+	// (only the streams holding attributes the program uses are bound)
+	// (if the buffer has been added to a MeshArena, returns the arena's vao for the program instead)
 	// note: will throw if program defines attributes not contained in this buffer
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and, for StreamsSplitPositions, the buffer containing the positions:
+	GLuint position_buffer = 0;
+	//...and, for indexed formats, the buffer containing the indices (bound to the element array of vaos made by make_vao_for_program):
+	GLuint index_buffer = 0;
+	//sizes of the above, in bytes:
+	size_t buffer_size = 0;
+	size_t position_buffer_size = 0;
+	size_t index_buffer_size = 0;
+
+	//if set, this buffer's data has been moved into an arena (see MeshArena::add):
+	MeshArena *arena = nullptr;
 
 	//-- internals ---
 
+	//(load_async() constructs buffers in two steps)
+	MeshBuffer() = default;
+
+	//read a file into meshes and data ready to upload; doesn't use OpenGL, so can be called from any thread:
+	struct Staging;
+	void parse(std::string const &filename, bool build_bvhs, Staging *staging);
+	//upload (at most max_bytes of) staged data; returns true once everything has been uploaded:
+	bool upload(Staging *staging, size_t max_bytes);
+
 	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	std::unordered_map< Name, Mesh, Name::Hash > meshes;
 
-	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
+	//These 'Attrib' structures describe the location of various attributes within the buffer (Position: within position_buffer, if streams are split) (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
 		GLint size = 0;
 		GLenum type = 0;
@@ -67,4 +182,60 @@ struct MeshBuffer {
 	Attrib Normal;
 	Attrib Color;
 	Attrib TexCoord;
+
+	//point the attributes a program uses at buffers laid out as described by the Attribs (used by make_vao_for_program and MeshArena):
+	// (position_vertex_buffer holds Position if streams are split; otherwise it is ignored)
+	// note: will throw if program defines attributes not contained in the buffer
+	void setup_vao(GLuint vao, GLuint program, GLuint vertex_buffer, GLuint position_vertex_buffer, GLuint element_buffer) const;
+};
+
+//A "MeshArena" holds the meshes of several MeshBuffers in one vertex buffer
+// (and one index buffer), so that drawing meshes from different files doesn't
+// need a different vertex array object for each file (and Scene::draw, which
+// sorts by vertex array, draws them without switching):
+//
+//   MeshArena arena(MeshBuffer::LayoutQuantized);
+//   arena.add(level_meshes);
+//   arena.add(character_meshes);
+//   GLuint vao = arena.vao_for_program(program); //(same as level_meshes->make_vao_for_program(program))
+//
+struct MeshArena {
+	MeshArena(MeshBuffer::Layout layout = MeshBuffer::LayoutFull, MeshBuffer::Streams streams = MeshBuffer::StreamsInterleaved);
+	//deletes the arena's buffers and vaos (so the arena must outlive drawing with the buffers added to it):
+	~MeshArena();
+	MeshArena(MeshArena const &) = delete;
+	MeshArena &operator=(MeshArena const &) = delete;
+
+	//move a buffer's data into the arena:
+	// copies its vertices and indices into the arena's buffers, points its meshes (and their levels of detail) at the copies,
+	// and deletes its own buffers. Vaos made for the buffer before this are no longer valid.
+	// note: will throw if the buffer's layout or streams don't match the arena's or the buffer is already in an arena.
+	void add(MeshBuffer *buffer);
+
+	//the arena's vertex array object for a program (made on first use; kept up to date as the arena grows):
+	// note: will throw if program defines attributes not contained in the arena
+	GLuint vao_for_program(GLuint program);
+
+	MeshBuffer::Layout layout;
+	MeshBuffer::Streams streams;
+
+	GLuint buffer = 0; //all vertices
+	GLuint position_buffer = 0; //all positions (for StreamsSplitPositions)
+	GLuint index_buffer = 0; //all indices (16- and 32-bit ranges, each aligned to 4 bytes)
+
+	//-- internals ---
+
+	//bytes in use and allocated in each buffer:
+	size_t buffer_used = 0, buffer_capacity = 0;
+	size_t position_buffer_used = 0, position_buffer_capacity = 0;
+	size_t index_buffer_used = 0, index_buffer_capacity = 0;
+
+	//attribute layout (copied from the first buffer added):
+	MeshBuffer format;
+
+	//vaos made by vao_for_program (program -> vao):
+	std::map< GLuint, GLuint > vaos;
+
+	//make sure the buffers can hold at least the given number of bytes (reallocating and copying if needed):
+	void reserve(size_t vertex_bytes, size_t position_bytes, size_t index_bytes);
 };
@@ -0,0 +1,342 @@
+#include "MeshBVH.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <cmath>
+
+namespace {
+	//closest point to p on triangle abc (Ericson, "Real-Time Collision Detection", 5.1.5):
+	glm::vec3 closest_point_on_triangle(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) {
+		glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0f && d4 <= d3) return b;
+
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + (d1 / (d1 - d3)) * ab;
+
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0f && d5 <= d6) return c;
+
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + (d2 / (d2 - d6)) * ac;
+
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+
+		float denom = 1.0f / (va + vb + vc);
+		return a + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	//closest points between segments p0-p1 and q0-q1 (Ericson 5.1.9):
+	void closest_points_on_segments(glm::vec3 const &p0, glm::vec3 const &p1, glm::vec3 const &q0, glm::vec3 const &q1, glm::vec3 *on_p, glm::vec3 *on_q) {
+		glm::vec3 d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+		float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+		float s = 0.0f, t = 0.0f;
+		if (a == 0.0f && e == 0.0f) {
+			//both are points
+		} else if (a == 0.0f) {
+			t = std::clamp(f / e, 0.0f, 1.0f);
+		} else {
+			float c = glm::dot(d1, r);
+			if (e == 0.0f) {
+				s = std::clamp(-c / a, 0.0f, 1.0f);
+			} else {
+				float b = glm::dot(d1, d2);
+				float denom = a * e - b * b;
+				if (denom != 0.0f) s = std::clamp((b * f - c * e) / denom, 0.0f, 1.0f);
+				t = (b * s + f) / e;
+				if (t < 0.0f) {
+					t = 0.0f;
+					s = std::clamp(-c / a, 0.0f, 1.0f);
+				} else if (t > 1.0f) {
+					t = 1.0f;
+					s = std::clamp((b - c) / a, 0.0f, 1.0f);
+				}
+			}
+		}
+		*on_p = p0 + d1 * s;
+		*on_q = q0 + d2 * t;
+	}
+
+	//ray-triangle intersection (Moller and Trumbore); returns t or infinity:
+	float ray_triangle(glm::vec3 const &origin, glm::vec3 const &direction, MeshBVH::Triangle const &tri) {
+		glm::vec3 e1 = tri.b - tri.a, e2 = tri.c - tri.a;
+		glm::vec3 p = glm::cross(direction, e2);
+		float det = glm::dot(e1, p);
+		if (det == 0.0f) return std::numeric_limits< float >::infinity();
+		float inv_det = 1.0f / det;
+		glm::vec3 s = origin - tri.a;
+		float u = glm::dot(s, p) * inv_det;
+		if (u < 0.0f || u > 1.0f) return std::numeric_limits< float >::infinity();
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(direction, q) * inv_det;
+		if (v < 0.0f || u + v > 1.0f) return std::numeric_limits< float >::infinity();
+		float t = glm::dot(e2, q) * inv_det;
+		if (t < 0.0f) return std::numeric_limits< float >::infinity();
+		return t;
+	}
+
+	//does origin + t * direction, t in [0, max_t], pass within 'pad' of the node's box? (returns entry t or infinity)
+	float ray_box(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, MeshBVH::Node const &node, float pad = 0.0f) {
+		float t0 = 0.0f, t1 = max_t;
+		for (uint32_t i = 0; i < 3; ++i) {
+			float lo = node.min[i] - pad, hi = node.max[i] + pad;
+			if (direction[i] == 0.0f) {
+				if (origin[i] < lo || origin[i] > hi) return std::numeric_limits< float >::infinity();
+				continue;
+			}
+			float inv = 1.0f / direction[i];
+			float t_near = (lo - origin[i]) * inv, t_far = (hi - origin[i]) * inv;
+			if (t_near > t_far) std::swap(t_near, t_far);
+			t0 = std::max(t0, t_near);
+			t1 = std::min(t1, t_far);
+			if (t0 > t1) return std::numeric_limits< float >::infinity();
+		}
+		return t0;
+	}
+
+	float box_distance2(glm::vec3 const &p, MeshBVH::Node const &node) {
+		glm::vec3 d = glm::max(node.min - p, glm::max(glm::vec3(0.0f), p - node.max));
+		return glm::dot(d, d);
+	}
+
+	glm::vec3 triangle_normal(MeshBVH::Triangle const &tri) {
+		glm::vec3 n = glm::cross(tri.b - tri.a, tri.c - tri.a);
+		float len = glm::length(n);
+		return (len > 0.0f ? n / len : glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+
+	//direction from point to query, or the triangle's normal if they touch:
+	glm::vec3 away_normal(glm::vec3 const &point, glm::vec3 const &query, MeshBVH::Triangle const &tri) {
+		glm::vec3 d = query - point;
+		float len = glm::length(d);
+		return (len > 0.0f ? d / len : triangle_normal(tri));
+	}
+}
+
+MeshBVH::MeshBVH(std::vector< glm::vec3 > const &in) {
+	constexpr uint32_t LeafTriangles = 4;
+
+	uint32_t count = uint32_t(in.size() / 3);
+	if (count == 0) return;
+
+	struct Item {
+		glm::vec3 min, max, centroid;
+		uint32_t id;
+	};
+	std::vector< Item > items(count);
+	for (uint32_t t = 0; t < count; ++t) {
+		glm::vec3 const &a = in[3*t+0], &b = in[3*t+1], &c = in[3*t+2];
+		items[t].min = glm::min(a, glm::min(b, c));
+		items[t].max = glm::max(a, glm::max(b, c));
+		items[t].centroid = (a + b + c) / 3.0f;
+		items[t].id = t;
+	}
+
+	//split nodes at the median centroid along their longest axis until leaves are small:
+	nodes.reserve(2 * count);
+	nodes.emplace_back();
+	std::vector< std::array< uint32_t, 3 > > todo; //(node, items begin, items end)
+	todo.push_back({{0, 0, count}});
+	while (!todo.empty()) {
+		auto [n, begin, end] = todo.back();
+		todo.pop_back();
+
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 centroid_min = min, centroid_max = max;
+		for (uint32_t i = begin; i < end; ++i) {
+			min = glm::min(min, items[i].min);
+			max = glm::max(max, items[i].max);
+			centroid_min = glm::min(centroid_min, items[i].centroid);
+			centroid_max = glm::max(centroid_max, items[i].centroid);
+		}
+		nodes[n].min = min;
+		nodes[n].max = max;
+
+		glm::vec3 extent = centroid_max - centroid_min;
+		uint32_t axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		if (end - begin <= LeafTriangles || extent[axis] == 0.0f) {
+			nodes[n].first = begin;
+			nodes[n].count = end - begin;
+			continue;
+		}
+
+		uint32_t mid = begin + (end - begin) / 2;
+		std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end, [axis](Item const &a, Item const &b) {
+			return a.centroid[axis] < b.centroid[axis];
+		});
+
+		uint32_t first = uint32_t(nodes.size());
+		nodes[n].first = first;
+		nodes.emplace_back();
+		nodes.emplace_back();
+		todo.push_back({{first, begin, mid}});
+		todo.push_back({{first + 1, mid, end}});
+	}
+
+	triangles.reserve(count);
+	triangle_ids.reserve(count);
+	for (Item const &item : items) {
+		triangles.emplace_back(Triangle{in[3*item.id+0], in[3*item.id+1], in[3*item.id+2]});
+		triangle_ids.emplace_back(item.id);
+	}
+}
+
+bool MeshBVH::ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit) const {
+	if (nodes.empty()) return false;
+
+	float best = max_t;
+	uint32_t best_triangle = -1U;
+
+	std::vector< uint32_t > stack;
+	stack.reserve(64);
+	if (ray_box(origin, direction, best, nodes[0]) <= best) stack.emplace_back(0);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		stack.pop_back();
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				float t = ray_triangle(origin, direction, triangles[i]);
+				if (t <= best) {
+					best = t;
+					best_triangle = i;
+				}
+			}
+		} else {
+			//visit the nearer child first (it is pushed last):
+			float t0 = ray_box(origin, direction, best, nodes[node.first]);
+			float t1 = ray_box(origin, direction, best, nodes[node.first + 1]);
+			if (t0 < t1) {
+				if (t1 <= best) stack.emplace_back(node.first + 1);
+				if (t0 <= best) stack.emplace_back(node.first);
+			} else {
+				if (t0 <= best) stack.emplace_back(node.first);
+				if (t1 <= best) stack.emplace_back(node.first + 1);
+			}
+		}
+	}
+
+	if (best_triangle == -1U) return false;
+	if (hit) {
+		hit->distance = best;
+		hit->point = origin + best * direction;
+		hit->normal = triangle_normal(triangles[best_triangle]);
+		hit->triangle = triangle_ids[best_triangle];
+	}
+	return true;
+}
+
+bool MeshBVH::sphere(glm::vec3 const &center, float radius, Hit *hit) const {
+	if (nodes.empty()) return false;
+
+	float best2 = radius * radius;
+	uint32_t best_triangle = -1U;
+	glm::vec3 best_point = glm::vec3(0.0f);
+
+	std::vector< uint32_t > stack;
+	stack.reserve(64);
+	stack.emplace_back(0);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		stack.pop_back();
+		if (box_distance2(center, node) > best2) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				Triangle const &tri = triangles[i];
+				glm::vec3 point = closest_point_on_triangle(center, tri.a, tri.b, tri.c);
+				float dis2 = glm::dot(point - center, point - center);
+				if (dis2 <= best2) {
+					best2 = dis2;
+					best_triangle = i;
+					best_point = point;
+				}
+			}
+		} else {
+			stack.emplace_back(node.first);
+			stack.emplace_back(node.first + 1);
+		}
+	}
+
+	if (best_triangle == -1U) return false;
+	if (hit) {
+		hit->distance = std::sqrt(best2);
+		hit->point = best_point;
+		hit->normal = away_normal(best_point, center, triangles[best_triangle]);
+		hit->triangle = triangle_ids[best_triangle];
+	}
+	return true;
+}
+
+bool MeshBVH::capsule(glm::vec3 const &a, glm::vec3 const &b, float radius, Hit *hit) const {
+	if (nodes.empty()) return false;
+
+	float best = radius;
+	uint32_t best_triangle = -1U;
+	glm::vec3 best_point = glm::vec3(0.0f);
+	glm::vec3 best_on_segment = glm::vec3(0.0f);
+
+	std::vector< uint32_t > stack;
+	stack.reserve(64);
+	stack.emplace_back(0);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		stack.pop_back();
+		//(padding the box by 'best' in every direction is conservative)
+		if (ray_box(a, b - a, 1.0f, node, best) > 1.0f) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				Triangle const &tri = triangles[i];
+
+				//segment passes through triangle:
+				float t = ray_triangle(a, b - a, tri);
+				if (t <= 1.0f) {
+					best = 0.0f;
+					best_triangle = i;
+					best_point = best_on_segment = a + t * (b - a);
+					continue;
+				}
+
+				//otherwise, the closest points involve an end of the segment or an edge of the triangle:
+				auto consider = [&](glm::vec3 const &on_segment, glm::vec3 const &on_triangle) {
+					float dis = glm::length(on_segment - on_triangle);
+					if (dis <= best) {
+						best = dis;
+						best_triangle = i;
+						best_point = on_triangle;
+						best_on_segment = on_segment;
+					}
+				};
+				consider(a, closest_point_on_triangle(a, tri.a, tri.b, tri.c));
+				consider(b, closest_point_on_triangle(b, tri.a, tri.b, tri.c));
+				glm::vec3 corners[3] = {tri.a, tri.b, tri.c};
+				for (uint32_t e = 0; e < 3; ++e) {
+					glm::vec3 on_segment, on_edge;
+					closest_points_on_segments(a, b, corners[e], corners[(e+1)%3], &on_segment, &on_edge);
+					consider(on_segment, on_edge);
+				}
+			}
+		} else {
+			stack.emplace_back(node.first);
+			stack.emplace_back(node.first + 1);
+		}
+	}
+
+	if (best_triangle == -1U) return false;
+	if (hit) {
+		hit->distance = best;
+		hit->point = best_point;
+		hit->normal = away_normal(best_point, best_on_segment, triangles[best_triangle]);
+		hit->triangle = triangle_ids[best_triangle];
+	}
+	return true;
+}
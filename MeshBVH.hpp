@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * A "MeshBVH" is a bounding volume hierarchy over the triangles of a mesh,
+ *  for geometric queries against its actual shape (rather than its bounding
+ *  box): ray casts, and sphere and capsule overlaps.
+ *
+ * MeshBuffer builds one per mesh (in parallel) when asked to; see Mesh::bvh.
+ *
+ * Queries are in the mesh's object space, so transform queries into it first,
+ *  e.g., for a drawable:
+ *
+ *   glm::mat4x3 world_to_object = drawable.transform->make_world_to_local();
+ *   MeshBVH::Hit hit;
+ *   if (mesh.bvh->ray(world_to_object * glm::vec4(origin, 1.0f), world_to_object * glm::vec4(direction, 0.0f), 1.0f, &hit)) { ... }
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct MeshBVH {
+	//build from a list of triangles (three positions per triangle):
+	MeshBVH(std::vector< glm::vec3 > const &triangles);
+
+	//Results of queries:
+	struct Hit {
+		//ray(): hit position as a multiple of the ray's direction
+		//sphere(), capsule(): distance from the query shape's center (line) to 'point'
+		float distance = 0.0f;
+		glm::vec3 point = glm::vec3(0.0f); //closest (or first) point on the mesh
+		//ray(): triangle's (unit, counter-clockwise) normal
+		//sphere(), capsule(): unit direction from 'point' toward the query shape (triangle normal if touching)
+		glm::vec3 normal = glm::vec3(0.0f);
+		uint32_t triangle = -1U; //index of the triangle hit (in the order passed to the constructor)
+	};
+
+	//first hit along origin + t * direction, for t in [0, max_t]:
+	// (both sides of triangles are hit)
+	bool ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit) const;
+
+	//closest point on the mesh within radius of center (if any):
+	bool sphere(glm::vec3 const &center, float radius, Hit *hit) const;
+
+	//closest point on the mesh within radius of the segment a-b (if any):
+	bool capsule(glm::vec3 const &a, glm::vec3 const &b, float radius, Hit *hit) const;
+
+	//-- internals ---
+
+	struct Triangle {
+		glm::vec3 a, b, c;
+	};
+	//triangles, reordered so that each leaf's triangles are consecutive:
+	std::vector< Triangle > triangles;
+	std::vector< uint32_t > triangle_ids; //original index of each triangle
+
+	//nodes[0] is the root; inner nodes have their children at nodes[first] and nodes[first+1]:
+	struct Node {
+		glm::vec3 min, max;
+		uint32_t first = 0;
+		uint32_t count = 0; //if non-zero, node is a leaf with triangles [first, first+count)
+	};
+	std::vector< Node > nodes;
+};
@@ -0,0 +1,213 @@
+#include "MeshFile.hpp"
+
+#include "ChunkFile.hpp"
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <unordered_map>
+#include <map>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	struct IndexedEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+		uint32_t index_begin, index_end; //indices are relative to vertex_begin
+	};
+	static_assert(sizeof(IndexedEntry) == 24, "Indexed entry should be packed");
+
+	//vertices are merged only if they are bitwise-identical:
+	struct VertexHash {
+		size_t operator()(MeshFile::Vertex const &v) const {
+			//FNV-1a over the vertex's bytes:
+			uint64_t hash = 0xcbf29ce484222325ULL;
+			unsigned char const *bytes = reinterpret_cast< unsigned char const * >(&v);
+			for (size_t i = 0; i < sizeof(MeshFile::Vertex); ++i) {
+				hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+			}
+			return size_t(hash);
+		}
+	};
+	struct VertexEqual {
+		bool operator()(MeshFile::Vertex const &a, MeshFile::Vertex const &b) const {
+			return std::memcmp(&a, &b, sizeof(MeshFile::Vertex)) == 0;
+		}
+	};
+
+	bool ends_with(std::string const &str, std::string const &suffix) {
+		return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+	}
+}
+
+MeshFile::MeshFile(std::string const &filename) {
+	ChunkFile file(filename);
+
+	if (ends_with(filename, ".pnct")) {
+		indexed = false;
+	} else if (ends_with(filename, ".pnci")) {
+		indexed = true;
+	} else {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
+
+	ChunkFile::Span< Vertex > in_vertices = file.read< Vertex >("pnct");
+	vertices.assign(in_vertices.begin(), in_vertices.end());
+
+	if (indexed) {
+		ChunkFile::Chunk chunk;
+		if (file.find("ix16", &chunk)) {
+			ChunkFile::Span< uint16_t > in_indices = file.read< uint16_t >(chunk);
+			indices.assign(in_indices.begin(), in_indices.end());
+		} else if (file.find("ix32", &chunk)) {
+			ChunkFile::Span< uint32_t > in_indices = file.read< uint32_t >(chunk);
+			indices.assign(in_indices.begin(), in_indices.end());
+		} else {
+			throw std::runtime_error("Mesh file '" + filename + "' has no index chunk.");
+		}
+		file.seek_past(chunk);
+	}
+
+	ChunkFile::Span< char > strings = file.read< char >("str0");
+
+	auto add_mesh = [&](uint32_t name_begin, uint32_t name_end, uint32_t vertex_begin, uint32_t vertex_end) -> Mesh & {
+		if (!(name_begin <= name_end && name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(vertex_begin <= vertex_end && vertex_end <= vertices.size())) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		meshes.emplace_back();
+		meshes.back().name = std::string(strings.data() + name_begin, strings.data() + name_end);
+		meshes.back().vertex_begin = vertex_begin;
+		meshes.back().vertex_end = vertex_end;
+		return meshes.back();
+	};
+
+	if (!indexed) {
+		for (auto const &entry : file.read< IndexEntry >("idx0")) {
+			add_mesh(entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end);
+		}
+	} else {
+		for (auto const &entry : file.read< IndexedEntry >("idx1")) {
+			Mesh &mesh = add_mesh(entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end);
+			if (!(entry.index_begin <= entry.index_end && entry.index_end <= indices.size())) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
+			}
+			for (uint32_t i = entry.index_begin; i < entry.index_end; ++i) {
+				if (indices[i] >= entry.vertex_end - entry.vertex_begin) {
+					throw std::runtime_error("index entry has out-of-range vertex index");
+				}
+			}
+			mesh.index_begin = entry.index_begin;
+			mesh.index_end = entry.index_end;
+		}
+	}
+}
+
+void MeshFile::save(std::string const &filename) const {
+	std::vector< char > strings;
+	auto add_name = [&strings](std::string const &name, uint32_t *begin, uint32_t *end) {
+		*begin = uint32_t(strings.size());
+		strings.insert(strings.end(), name.begin(), name.end());
+		*end = uint32_t(strings.size());
+	};
+
+	std::ofstream blob(filename, std::ios::binary);
+
+	if (!indexed) {
+		//same layout as export-meshes.py writes:
+		std::vector< IndexEntry > index;
+		index.reserve(meshes.size());
+		for (auto const &mesh : meshes) {
+			index.emplace_back();
+			add_name(mesh.name, &index.back().name_begin, &index.back().name_end);
+			index.back().vertex_begin = mesh.vertex_begin;
+			index.back().vertex_end = mesh.vertex_end;
+		}
+		write_chunk("pnct", vertices, &blob);
+		write_chunk("str0", strings, &blob);
+		write_chunk("idx0", index, &blob);
+	} else {
+		std::vector< IndexedEntry > index;
+		index.reserve(meshes.size());
+		for (auto const &mesh : meshes) {
+			index.emplace_back();
+			add_name(mesh.name, &index.back().name_begin, &index.back().name_end);
+			index.back().vertex_begin = mesh.vertex_begin;
+			index.back().vertex_end = mesh.vertex_end;
+			index.back().index_begin = mesh.index_begin;
+			index.back().index_end = mesh.index_end;
+		}
+
+		ChunkDirectoryWriter out;
+		out.add("pnct", vertices);
+		if (short_indices()) {
+			out.add("ix16", std::vector< uint16_t >(indices.begin(), indices.end()));
+		} else {
+			out.add("ix32", indices);
+		}
+		out.add("str0", strings);
+		out.add("idx1", index);
+		out.write(&blob);
+	}
+
+	if (!blob) {
+		throw std::runtime_error("Failed to write '" + filename + "'.");
+	}
+}
+
+bool MeshFile::short_indices() const {
+	for (auto const &mesh : meshes) {
+		if (mesh.vertex_end - mesh.vertex_begin > uint32_t(std::numeric_limits< uint16_t >::max()) + 1) return false;
+	}
+	return true;
+}
+
+void MeshFile::make_indexed() {
+	if (indexed) return;
+
+	std::vector< Vertex > new_vertices;
+	std::vector< uint32_t > new_indices;
+
+	//meshes that share a vertex range also share output vertices and indices:
+	std::map< std::pair< uint32_t, uint32_t >, Mesh > converted;
+
+	for (auto &mesh : meshes) {
+		auto f = converted.find(std::make_pair(mesh.vertex_begin, mesh.vertex_end));
+		if (f == converted.end()) {
+			Mesh out;
+			out.vertex_begin = uint32_t(new_vertices.size());
+			out.index_begin = uint32_t(new_indices.size());
+
+			std::unordered_map< Vertex, uint32_t, VertexHash, VertexEqual > lookup;
+			lookup.reserve(mesh.vertex_end - mesh.vertex_begin);
+			for (uint32_t v = mesh.vertex_begin; v < mesh.vertex_end; ++v) {
+				auto ret = lookup.emplace(vertices[v], uint32_t(new_vertices.size()) - out.vertex_begin);
+				if (ret.second) new_vertices.emplace_back(vertices[v]);
+				new_indices.emplace_back(ret.first->second);
+			}
+
+			out.vertex_end = uint32_t(new_vertices.size());
+			out.index_end = uint32_t(new_indices.size());
+
+			f = converted.emplace(std::make_pair(mesh.vertex_begin, mesh.vertex_end), out).first;
+		}
+		mesh.vertex_begin = f->second.vertex_begin;
+		mesh.vertex_end = f->second.vertex_end;
+		mesh.index_begin = f->second.index_begin;
+		mesh.index_end = f->second.index_end;
+	}
+
+	vertices = std::move(new_vertices);
+	indices = std::move(new_indices);
+	indexed = true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * "MeshFile" is an in-memory copy of a mesh file ('.pnct' or '.pnci'; see Mesh.hpp),
+ *  for tools that process meshes offline (index-meshes, optimize-meshes).
+ * It doesn't use OpenGL -- MeshBuffer is what loads meshes for drawing.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct MeshFile {
+	//read a '.pnct' or '.pnci' file (depending on extension):
+	// note: will throw if file fails to read.
+	MeshFile(std::string const &filename);
+	MeshFile() = default;
+
+	//write a '.pnci' file if 'indexed' is set, otherwise a '.pnct' file:
+	// note: will throw if file fails to write.
+	void save(std::string const &filename) const;
+
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	struct Mesh {
+		std::string name;
+		uint32_t vertex_begin = 0, vertex_end = 0;
+		uint32_t index_begin = 0, index_end = 0; //(only used if indexed)
+	};
+
+	bool indexed = false;
+	std::vector< Vertex > vertices;
+	std::vector< uint32_t > indices; //relative to the vertex_begin of their mesh
+	std::vector< Mesh > meshes;
+
+	//can indices be stored in 16 bits? (they are relative to each mesh, so this is true unless some mesh is very large)
+	bool short_indices() const;
+
+	//merge bitwise-identical vertices within each mesh and switch to indexed storage:
+	// (meshes that share a vertex range keep sharing it)
+	void make_indexed();
+};
@@ -0,0 +1,94 @@
+#include "Name.hpp"
+
+#include <atomic>
+#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+	struct Table {
+		std::mutex mutex; //held while adding strings (str() doesn't need it)
+		//strings, in chunks that are allocated as the table grows and never move or shrink:
+		// chunk 0 holds ids [0, FirstChunk); chunk c > 0 holds ids [FirstChunk << (c-1), FirstChunk << c)
+		// (so 'ids' can point into them, and str() can read an existing id's string without locking)
+		enum : uint32_t { FirstChunkBits = 6, FirstChunk = 1 << FirstChunkBits, Chunks = 32 - FirstChunkBits + 1 };
+		std::atomic< std::string * > chunks[Chunks] = { };
+		uint64_t count = 0; //strings in the table
+		std::unordered_map< std::string_view, uint32_t > ids;
+
+		Table() {
+			ids.emplace(std::string_view(add(std::string_view())), 0);
+		}
+
+		//chunk and offset in chunk for an id:
+		static void locate(uint32_t id, uint32_t *chunk, uint32_t *offset) {
+			if (id < FirstChunk) {
+				*chunk = 0;
+				*offset = id;
+				return;
+			}
+			uint32_t bit = 31;
+			while (!(id & (1U << bit))) --bit;
+			*chunk = bit - FirstChunkBits + 1;
+			*offset = id - (1U << bit);
+		}
+
+		//add a string (mutex must be held); returns the stored copy:
+		std::string const &add(std::string_view const &str) {
+			uint32_t chunk, offset;
+			locate(uint32_t(count), &chunk, &offset);
+			std::string *strings = chunks[chunk].load(std::memory_order_relaxed);
+			if (!strings) {
+				strings = new std::string[chunk == 0 ? FirstChunk : (FirstChunk << (chunk - 1))];
+				chunks[chunk].store(strings, std::memory_order_release);
+			}
+			strings[offset] = str;
+			++count;
+			return strings[offset];
+		}
+
+		std::string const &get(uint32_t id) const {
+			uint32_t chunk, offset;
+			locate(id, &chunk, &offset);
+			return chunks[chunk].load(std::memory_order_acquire)[offset];
+		}
+	};
+
+	//Name is just an id into this table, so the table has to exist for as long as any Name might be
+	// made or printed. Names live inside other files' globals (mesh names in a MeshBuffer, say),
+	// so that can happen before this file's globals exist or after they are destroyed -- hence a
+	// table created on first use and deliberately leaked.
+	Table &table() {
+		static Table *table = new Table;
+		return *table;
+	}
+}
+
+Name::Name(std::string_view const &str) {
+	Table &t = table();
+	std::lock_guard< std::mutex > lock(t.mutex);
+	auto f = t.ids.find(str);
+	if (f != t.ids.end()) {
+		id = f->second;
+		return;
+	}
+	if (t.count > uint64_t(-1U)) {
+		throw std::runtime_error("Too many distinct names.");
+	}
+	id = uint32_t(t.count);
+	t.ids.emplace(std::string_view(t.add(str)), id);
+}
+
+Name Name::find(std::string_view const &str) {
+	Table &t = table();
+	std::lock_guard< std::mutex > lock(t.mutex);
+	Name ret;
+	auto f = t.ids.find(str);
+	if (f != t.ids.end()) ret.id = f->second;
+	return ret;
+}
+
+std::string const &Name::str() const {
+	//(no lock: this name's id was handed out after its string was stored, and stored strings never change)
+	return table().get(id);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * A "Name" is an interned string: each distinct string is stored once, in a
+ *  global table, and names refer to it by a compact id. So copying, comparing,
+ *  and hashing names is as cheap as it is for an integer.
+ *
+ * Meshes (MeshBuffer::meshes) and transforms (Scene::Transform::name) are
+ *  named this way, e.g.:
+ *
+ *   static Name const jewel("jewel.001"); //(interned once)
+ *   Scene::Transform *transform = scene.find_transform(jewel);
+ *
+ * Interning is explicit, since every distinct string stays in the table for
+ *  good; to look up a name that may not exist, use Name::find instead:
+ *
+ *   Scene::Transform *transform = scene.find_transform(Name::find(some_string));
+ *
+ * The table only ever grows, and may be used from any thread. Reading a
+ *  name's string (str()) doesn't lock, so it is fine in per-object loops.
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+struct Name {
+	//the empty name:
+	Name() = default;
+
+	//intern a string (adding it to the table if it isn't there yet):
+	explicit Name(std::string_view const &str);
+	explicit Name(std::string const &str) : Name(std::string_view(str)) { }
+	explicit Name(char const *str) : Name(std::string_view(str)) { }
+
+	//look up a string without adding it to the table:
+	// returns the empty name if the string has never been interned
+	static Name find(std::string_view const &str);
+
+	//the interned string:
+	std::string const &str() const;
+
+	bool empty() const { return id == 0; }
+	bool operator==(Name const &other) const { return id == other.id; }
+	bool operator!=(Name const &other) const { return id != other.id; }
+
+	//for unordered containers keyed by name:
+	struct Hash {
+		size_t operator()(Name const &name) const { return size_t(name.id); }
+	};
+
+	uint32_t id = 0; //index of the string in the table (the empty string is always 0)
+};
@@ -1,6 +1,7 @@
 #include "PlayMode.hpp"
 
 #include "LitColorTextureProgram.hpp"
+#include "DepthProgram.hpp"
 
 #include "DrawLines.hpp"
 #include "Mesh.hpp"
@@ -13,26 +14,33 @@
 #include <random>
 #include <cmath>
 
+//the meshes are read in the background (starting early) while the sounds below load:
+MeshBuffer::Pending platformer_meshes_pending;
+Load< void > start_platformer_meshes(LoadTagEarly, [](){
+	//(positions in their own stream, so the depth pre-pass reads only those)
+	platformer_meshes_pending = MeshBuffer::load_async(data_path("platformer.pnci"), MeshBuffer::LayoutQuantized, false, MeshBuffer::StreamsSplitPositions);
+});
+
 GLuint platformer_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > platformer_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("platformer.pnct"));
+GLuint platformer_meshes_for_depth_program = 0;
+Load< MeshBuffer > platformer_meshes(LoadTagLate, []() -> MeshBuffer const * {
+	MeshBuffer const *ret = platformer_meshes_pending.wait();
 	platformer_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	platformer_meshes_for_depth_program = ret->make_vao_for_program(depth_program->program);
 	return ret;
 });
 
-Load< Scene > platformer_scene(LoadTagDefault, []() -> Scene const * {
+Load< Scene > platformer_scene(LoadTagLate, []() -> Scene const * {
 	return new Scene(data_path("platformer.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = platformer_meshes->lookup(mesh_name);
 
-		scene.drawables.emplace_back(transform);
-		Scene::Drawable &drawable = scene.drawables.back();
+		Scene::Drawable &drawable = scene.drawables.emplace(transform);
 
 		drawable.pipeline = lit_color_texture_program_pipeline;
 
 		drawable.pipeline.vao = platformer_meshes_for_lit_color_texture_program;
-		drawable.pipeline.type = mesh.type;
-		drawable.pipeline.start = mesh.start;
-		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.depth_vao = platformer_meshes_for_depth_program;
+		drawable.set_mesh(mesh); //(draw range and levels of detail)
 
 	});
 });
@@ -77,16 +85,17 @@ PlayMode::PlayMode() : scene(*platformer_scene) {
 	//get pointers to leg for convenience:
 	for (auto &transform : scene.transforms) {
 		//referenced for checking is a string includes a substring: https://stackoverflow.com/questions/2340281/check-if-a-string-contains-a-string-in-c
-		if (transform.name.find("final") != std::string::npos) collect_locations.push_back(&transform);
-		if (transform.name.find("ground") != std::string::npos) ground_transforms.push_back(&transform);
-		else if (transform.name == "jewel.001") bflat.transform = &transform;
-		else if (transform.name == "jewel.002") c.transform = &transform;
-		else if (transform.name == "jewel.003") d.transform = &transform;
-		else if (transform.name == "jewel.004") eflat.transform = &transform;
-		else if (transform.name == "jewel.005") f.transform = &transform;
-		else if (transform.name == "jewel.006") g.transform = &transform;
-		else if (transform.name == "jewel.007") a.transform = &transform;
+		std::string const &name = transform.name.str();
+		if (name.find("final") != std::string::npos) collect_locations.push_back(&transform);
+		if (name.find("ground") != std::string::npos) ground_transforms.push_back(&transform);
 	}
+	bflat.transform = scene.find_transform(Name::find("jewel.001"));
+	c.transform = scene.find_transform(Name::find("jewel.002"));
+	d.transform = scene.find_transform(Name::find("jewel.003"));
+	eflat.transform = scene.find_transform(Name::find("jewel.004"));
+	f.transform = scene.find_transform(Name::find("jewel.005"));
+	g.transform = scene.find_transform(Name::find("jewel.006"));
+	a.transform = scene.find_transform(Name::find("jewel.007"));
 	if (bflat.transform == nullptr) throw std::runtime_error("B-Flat collectible not found.");
 	if (c.transform == nullptr) throw std::runtime_error("C collectible not found.");
 	if (d.transform == nullptr) throw std::runtime_error("D collectible not found.");
@@ -97,7 +106,7 @@ PlayMode::PlayMode() : scene(*platformer_scene) {
 
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
-	camera = &scene.cameras.front();
+	camera = &*scene.cameras.begin();
 
 	//start music loop playing:
 	bgm = Sound::play_3D(*full_sample, 1.0f, ground_transforms.front()->position, 1.0f);
@@ -482,15 +491,13 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 	//set up light type and position for lit_color_texture_program:
+	// (scene.draw passes this to the program in its Frame uniform block)
 	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	GL_ERRORS();
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	GL_ERRORS();
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
-	GL_ERRORS();
-	glUseProgram(0);
+	LitColorTextureProgram::FrameLight light;
+	light.type = LitColorTextureProgram::FrameLight::Hemisphere;
+	light.direction = glm::vec3(0.0f, 0.0f,-1.0f);
+	light.energy = glm::vec3(1.0f, 1.0f, 0.95f);
+	scene.set_frame_payload(light);
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
@@ -499,7 +506,14 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
 
+	//depth pre-pass: lay down depth (reading only positions), so the lit pass below shades each pixel once:
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	scene.draw_depth(*camera, depth_program_material);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	glDepthFunc(GL_LEQUAL); //(the lit pass computes the same depths, so it passes exactly where it is nearest)
 	scene.draw(*camera);
+	glDepthFunc(GL_LESS);
 
 	{ //use DrawLines to overlay some text:
 		glDisable(GL_DEPTH_TEST);
@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <deque>
+#include <list>
 
 struct PlayMode : Mode {
 	PlayMode();
@@ -0,0 +1,266 @@
+#pragma once
+
+/*
+ * A "Pool" stores objects in fixed-size blocks of slots, reusing the slots of
+ *  erased objects for new ones. Objects never move once placed, so pointers
+ *  and references to them stay valid until they are erased, and adding or
+ *  erasing objects doesn't allocate per object.
+ *
+ * Each slot has a generation count that changes whenever its object is
+ *  erased, so a Handle (slot + generation) can be checked for staleness:
+ *
+ *   Pool< Thing > things;
+ *   Thing &thing = things.emplace(...);
+ *   Pool< Thing >::Handle handle = things.handle(thing);
+ *   ...
+ *   things.erase(handle);
+ *   assert(things.get(handle) == nullptr); //(stale handles get nullptr)
+ *
+ * Iteration walks the slots in order, skipping empty ones. Slots are filled
+ *  in order until something is erased; after that, new objects take the most
+ *  recently freed slot. Erasing the current object while iterating is fine.
+ *
+ * Copies keep the same slot layout, so handles into one pool are valid in
+ *  its copies. Assigning over an existing pool makes every handle into its
+ *  old contents stale; only handles from the pool copied carry over (and
+ *  not even those for any slot the destination had already taken to a later
+ *  generation -- generations never go backwards, so an old handle can't
+ *  come back to life).
+ *
+ */
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+
+//(the same for every Pool, so types can name their own handles before they are complete)
+struct PoolHandle {
+	uint32_t index = -1U; //slot
+	uint32_t generation = 0; //(odd while the slot is filled; so 0 is never valid)
+	bool operator==(PoolHandle const &o) const { return index == o.index && generation == o.generation; }
+	bool operator!=(PoolHandle const &o) const { return !(*this == o); }
+};
+
+template< typename T, uint32_t BlockSize = 256 >
+struct Pool {
+	static_assert(BlockSize > 0 && (BlockSize & (BlockSize - 1)) == 0, "BlockSize must be a power of two.");
+
+	typedef PoolHandle Handle;
+
+	Pool() = default;
+	Pool(Pool const &other) { *this = other; }
+	Pool(Pool &&other) { swap(other); }
+	Pool &operator=(Pool const &other);
+	Pool &operator=(Pool &&other) { if (this != &other) { clear(); swap(other); } return *this; }
+	~Pool() { clear(); }
+
+	void swap(Pool &other) {
+		blocks.swap(other.blocks);
+		blocks_by_address.swap(other.blocks_by_address);
+		generations.swap(other.generations);
+		free_slots.swap(other.free_slots);
+		std::swap(count, other.count);
+	}
+
+	//number of objects:
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	//construct a new object (in a free slot, if there is one):
+	template< typename... Args >
+	T &emplace(Args&&... args);
+
+	//erase all objects:
+	// (handles to them become stale; slots are kept for reuse, and refilled in order)
+	void clear();
+
+	//handle for an object in the pool:
+	Handle handle(T const &object) const;
+
+	//object for a handle, or nullptr if the handle is stale:
+	T *get(Handle const &h) { return const_cast< T * >(static_cast< Pool const & >(*this).get(h)); }
+	T const *get(Handle const &h) const {
+		if (h.index >= generations.size() || generations[h.index] != h.generation || !(h.generation & 1)) return nullptr;
+		return slot(h.index);
+	}
+
+	//erase an object; returns false (and does nothing) if the handle is stale:
+	bool erase(Handle const &h);
+	void erase(T const &object) {
+		bool erased = erase(handle(object));
+		assert(erased && "object is in the pool");
+		(void)erased;
+	}
+
+	//forward iteration over objects in slot order:
+	template< typename P, typename V >
+	struct Iterator {
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = V *;
+		using reference = V &;
+
+		P *pool = nullptr;
+		uint32_t index = 0;
+
+		Iterator() = default;
+		Iterator(P *pool_, uint32_t index_) : pool(pool_), index(index_) { skip(); }
+		//(iterator converts to const_iterator)
+		template< typename P2, typename V2 >
+		Iterator(Iterator< P2, V2 > const &o) : pool(o.pool), index(o.index) { }
+
+		V &operator*() const { return *pool->slot(index); }
+		V *operator->() const { return pool->slot(index); }
+		Iterator &operator++() { ++index; skip(); return *this; }
+		Iterator operator++(int) { Iterator ret = *this; ++*this; return ret; }
+		bool operator==(Iterator const &o) const { return index == o.index; }
+		bool operator!=(Iterator const &o) const { return index != o.index; }
+
+		//skip empty slots:
+		void skip() {
+			uint32_t end = uint32_t(pool->generations.size());
+			while (index < end && !(pool->generations[index] & 1)) ++index;
+		}
+	};
+	using iterator = Iterator< Pool, T >;
+	using const_iterator = Iterator< Pool const, T const >;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, uint32_t(generations.size())); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, uint32_t(generations.size())); }
+
+private:
+	//uninitialized storage for one object:
+	struct Storage {
+		alignas(T) unsigned char bytes[sizeof(T)];
+	};
+	static_assert(sizeof(Storage) == sizeof(T), "Storage is laid out like an array of T.");
+	std::vector< std::unique_ptr< Storage[] > > blocks; //BlockSize slots each; never moved once allocated
+	std::vector< std::pair< T const *, uint32_t > > blocks_by_address; //(first object, block index), sorted by address -- used by handle()
+	std::vector< uint32_t > generations; //one per slot; odd when the slot holds an object
+	std::vector< uint32_t > free_slots; //empty slots, used from the back
+	size_t count = 0;
+
+	T *slot(uint32_t index) const {
+		return std::launder(reinterpret_cast< T * >(blocks[index / BlockSize][index % BlockSize].bytes));
+	}
+
+	//make sure there are blocks for slots [0, slots):
+	void reserve_slots(size_t slots) {
+		while (blocks.size() * BlockSize < slots) {
+			blocks.emplace_back(new Storage[BlockSize]);
+			std::pair< T const *, uint32_t > entry(reinterpret_cast< T const * >(blocks.back()[0].bytes), uint32_t(blocks.size() - 1));
+			auto at = std::upper_bound(blocks_by_address.begin(), blocks_by_address.end(), entry, [](auto const &a, auto const &b) {
+				return std::less< T const * >()(a.first, b.first);
+			});
+			blocks_by_address.insert(at, entry);
+		}
+	}
+};
+
+template< typename T, uint32_t BlockSize >
+template< typename... Args >
+T &Pool< T, BlockSize >::emplace(Args&&... args) {
+	uint32_t index;
+	if (!free_slots.empty()) {
+		index = free_slots.back();
+	} else {
+		index = uint32_t(generations.size());
+		reserve_slots(size_t(index) + 1);
+	}
+	T *object = new (blocks[index / BlockSize][index % BlockSize].bytes) T(std::forward< Args >(args)...);
+	//(only mark the slot as filled once construction has succeeded)
+	if (!free_slots.empty()) {
+		free_slots.pop_back();
+		generations[index] += 1;
+	} else {
+		generations.emplace_back(1);
+	}
+	++count;
+	return *object;
+}
+
+template< typename T, uint32_t BlockSize >
+void Pool< T, BlockSize >::clear() {
+	for (uint32_t i = 0; i < generations.size(); ++i) {
+		if (generations[i] & 1) {
+			slot(i)->~T();
+			generations[i] += 1;
+		}
+	}
+	count = 0;
+	//refill in slot order:
+	free_slots.clear();
+	free_slots.reserve(generations.size());
+	for (uint32_t i = uint32_t(generations.size()); i > 0; --i) {
+		free_slots.emplace_back(i - 1);
+	}
+}
+
+template< typename T, uint32_t BlockSize >
+Pool< T, BlockSize > &Pool< T, BlockSize >::operator=(Pool const &other) {
+	if (this == &other) return *this;
+	clear();
+	reserve_slots(other.generations.size());
+	//slots that other doesn't have stay empty (after its slots, in the free list):
+	std::vector< uint32_t > extra_slots;
+	for (uint32_t i = uint32_t(generations.size()); i > other.generations.size(); --i) {
+		extra_slots.emplace_back(i - 1);
+	}
+	generations.resize(std::max(generations.size(), other.generations.size()), 0);
+	for (uint32_t i = 0; i < other.generations.size(); ++i) {
+		bool filled = (other.generations[i] & 1);
+		if (filled) {
+			new (blocks[i / BlockSize][i % BlockSize].bytes) T(*other.slot(i));
+			++count;
+		}
+		//take other's generation, unless that would go back past one this slot has already handed out:
+		// (after clear(), generations[i] is even and past every handle made for this slot so far)
+		uint32_t generation = std::max(generations[i], other.generations[i]);
+		if (bool(generation & 1) != filled) generation += 1;
+		generations[i] = generation;
+	}
+	free_slots = std::move(extra_slots);
+	free_slots.insert(free_slots.end(), other.free_slots.begin(), other.free_slots.end());
+	return *this;
+}
+
+template< typename T, uint32_t BlockSize >
+typename Pool< T, BlockSize >::Handle Pool< T, BlockSize >::handle(T const &object) const {
+	//find the block holding the object -- the last one starting at or before it:
+	// (std::less gives a total order even for pointers into different blocks)
+	std::less< T const * > less;
+	auto after = std::upper_bound(blocks_by_address.begin(), blocks_by_address.end(), &object, [&less](T const *a, auto const &b) {
+		return less(a, b.first);
+	});
+	if (after == blocks_by_address.begin() || !less(&object, std::prev(after)->first + BlockSize)) {
+		assert(false && "object is in the pool");
+		return Handle();
+	}
+	auto const &[first, block] = *std::prev(after);
+	Handle ret;
+	ret.index = block * BlockSize + uint32_t(&object - first);
+	assert(ret.index < generations.size() && (generations[ret.index] & 1) && "object is in the pool");
+	ret.generation = generations[ret.index];
+	return ret;
+}
+
+template< typename T, uint32_t BlockSize >
+bool Pool< T, BlockSize >::erase(Handle const &h) {
+	T *object = get(h);
+	if (!object) return false;
+	object->~T();
+	generations[h.index] += 1;
+	free_slots.emplace_back(h.index);
+	--count;
+	return true;
+}
@@ -1,11 +1,18 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
-#include "read_write_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "Mesh.hpp"
+#include "Jobs.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <iostream>
+#include <streambuf>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cmath>
 
 //-------------------------
 
@@ -57,29 +64,88 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 }
 
 glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
-	}
+	update_cache();
+	return cache.local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
+	update_cache();
+	return cache.world_to_local;
+}
+
+void Scene::Transform::update_cache() const {
+	uint32_t parent_stamp = 0;
+	if (parent) {
+		parent->update_cache();
+		parent_stamp = parent->cache.stamp;
+	}
+
+	if (cache.stamp != 0
+	 && cache.position == position && cache.rotation == rotation && cache.scale == scale
+	 && cache.parent == parent && cache.parent_stamp == parent_stamp) return;
+
 	if (!parent) {
-		return make_parent_to_local();
+		cache.local_to_world = make_local_to_parent();
+		cache.world_to_local = make_parent_to_local();
 	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		//note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		cache.local_to_world = parent->cache.local_to_world * glm::mat4(make_local_to_parent());
+		cache.world_to_local = make_parent_to_local() * glm::mat4(parent->cache.world_to_local);
 	}
+
+	cache.position = position;
+	cache.rotation = rotation;
+	cache.scale = scale;
+	cache.parent = parent;
+	cache.parent_stamp = parent_stamp;
+	//stamps are unique across all transforms, so a child notices even if its parent is replaced by another transform:
+	static std::atomic< uint32_t > next_stamp(1);
+	cache.stamp = next_stamp.fetch_add(1, std::memory_order_relaxed);
+	if (cache.stamp == 0) cache.stamp = next_stamp.fetch_add(1, std::memory_order_relaxed); //(0 is reserved for 'never built')
 }
 
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
+	return make_projection(fovy, aspect, near);
+}
+
+glm::mat4 Scene::Camera::make_projection(float fovy, float aspect, float near) {
 	return glm::infinitePerspective( fovy, aspect, near );
 }
 
 //-------------------------
 
 
+void Scene::Drawable::set_mesh(Mesh const &mesh) {
+	pipeline.type = mesh.type;
+	pipeline.start = mesh.start;
+	pipeline.count = mesh.count;
+	pipeline.index_type = mesh.index_type;
+	pipeline.base_vertex = mesh.base_vertex;
+	pipeline.position_scale = mesh.position_scale;
+	pipeline.position_offset = mesh.position_offset;
+
+	min = mesh.min;
+	max = mesh.max;
+	has_bounds = true;
+
+	lods.clear();
+	float max_screen_size = LODScreenSize;
+	for (Mesh const &level : mesh.lods) {
+		lods.emplace_back();
+		LOD &lod = lods.back();
+		lod.max_screen_size = max_screen_size;
+		lod.start = level.start;
+		lod.count = level.count;
+		lod.base_vertex = level.base_vertex;
+		lod.position_scale = level.position_scale;
+		lod.position_offset = level.position_offset;
+		max_screen_size *= 0.5f;
+	}
+}
+
+//-------------------------
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
@@ -88,76 +154,416 @@ void Scene::draw(Camera const &camera) const {
 }
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	list_drawables();
+	draw_list(draw_buffers, world_to_clip, world_to_light, sort_drawables, frame_payload, &draw_stats);
+}
+
+void Scene::draw_depth(Camera const &camera, Material::Handle const &material) const {
+	assert(camera.transform);
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	draw_depth(world_to_clip, material);
+}
+
+void Scene::draw_depth(glm::mat4 const &world_to_clip, Material::Handle const &material) const {
+	Material const *depth_material = Material::get(material);
+	if (!depth_material || depth_material->program == 0) return;
+	list_drawables();
+	draw_list(draw_buffers, world_to_clip, glm::mat4x3(1.0f), sort_drawables, frame_payload, &draw_stats, depth_material);
+}
 
-	//Iterate through all drawables, sending each one to OpenGL:
+void Scene::list_drawables() const {
+	//List every drawable along with its world matrix:
+	// World matrices are cached in each transform, and checking a cache may rebuild its ancestors' caches,
+	// so bring every drawable's transform up to date here, on one thread; draw_list can then read them from any thread.
+	draw_buffers.list.clear();
 	for (auto const &drawable : drawables) {
+		assert(drawable.transform); //drawables *must* have a transform
+		drawable.transform->update_cache();
+		draw_buffers.list.emplace_back();
+		draw_buffers.list.back().drawable = &drawable;
+		draw_buffers.list.back().object_to_world = &drawable.transform->cache.local_to_world;
+	}
+}
+
+namespace {
+	//size of a program's "Frame" uniform block (0 if it has none), looked up once per program:
+	// (draw_list pads the frame data out to this, so a program whose payload hasn't been set reads zeros rather than past the end of the buffer)
+	GLint frame_block_size(GLuint program) {
+		static std::unordered_map< GLuint, GLint > sizes;
+		auto f = sizes.find(program);
+		if (f != sizes.end()) return f->second;
+		GLint size = 0;
+		GLuint index = glGetUniformBlockIndex(program, "Frame");
+		if (index != GL_INVALID_INDEX) glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+		sizes.emplace(program, size);
+		return size;
+	}
+}
+
+void Scene::draw_list(DrawBuffers &buffers, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, bool sort_drawables, std::vector< char > const &frame_payload, DrawStats *stats_, Material const *depth_material) {
+	assert(stats_);
+	DrawStats &draw_stats = *stats_;
+	draw_stats = DrawStats();
+
+	//(names for the buffers, for convenience)
+	std::vector< DrawEntry > const &entries = buffers.list;
+	std::vector< DrawItem > &draw_queue = buffers.queue;
+	std::vector< ObjectData > &draw_objects = buffers.objects;
+	std::vector< char > &object_data = buffers.object_data;
+
+	//First, in parallel (in chunks of DrawChunkSize), cull, pick levels of detail, and compute matrices:
+	// every entry gets a slot in draw_queue (drawable == nullptr if it was skipped or culled) and in draw_objects
+	draw_queue.assign(entries.size(), DrawItem());
+	draw_objects.resize(entries.size());
+	uint32_t chunks = (uint32_t(entries.size()) + DrawChunkSize - 1) / DrawChunkSize;
+	auto gather = [&](uint32_t index, DrawStats &stats) {
+		Scene::Drawable const &drawable = *entries[index].drawable;
+		DrawItem &item = draw_queue[index];
+		item.order = index;
+
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
-		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		//skip any drawables without a material, or whose material has no shader program set:
+		// (a depth pass draws every drawable with depth_material, through the drawable's depth_vao)
+		Material const *material = (depth_material ? depth_material : Material::get(pipeline.material));
+		if (!material || material->program == 0) return;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		GLuint vao = (depth_material ? pipeline.depth_vao : pipeline.vao);
+		if (vao == 0) return;
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
-
-
-		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (pipeline.count == 0) return;
+
+		//the object-to-world matrix is used for culling, to pick a level of detail, and in all three matrices below:
+		glm::mat4x3 const &object_to_world = *entries[index].object_to_world;
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+
+		//skip drawables whose bounds are entirely outside the view frustum:
+		if (drawable.has_bounds) {
+			stats.tested += 1;
+			//points are inside when -w <= x,y,z <= w in clip space,
+			// so the frustum's planes (in object space) are sums and differences of the rows of object_to_clip:
+			glm::vec4 rows[4];
+			for (uint32_t r = 0; r < 4; ++r) {
+				rows[r] = glm::vec4(object_to_clip[0][r], object_to_clip[1][r], object_to_clip[2][r], object_to_clip[3][r]);
+			}
+			glm::vec3 center = 0.5f * (drawable.max + drawable.min);
+			glm::vec3 extent = 0.5f * (drawable.max - drawable.min);
+			//the box is outside a plane if even its corner farthest along the plane's normal is behind it:
+			auto outside = [&center, &extent](glm::vec4 const &plane) {
+				glm::vec3 normal = glm::vec3(plane);
+				return glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) + plane.w < 0.0f;
+			};
+			if (outside(rows[3] + rows[0]) || outside(rows[3] - rows[0])
+			 || outside(rows[3] + rows[1]) || outside(rows[3] - rows[1])
+			 || outside(rows[3] + rows[2]) || outside(rows[3] - rows[2])) {
+				stats.culled += 1;
+				return;
+			}
+		}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		item.drawable = &drawable;
+		item.material = material;
+		item.vao = vao;
+
+		//pick a level of detail based on the size of the drawable's bounding sphere on screen:
+		item.start = pipeline.start;
+		item.count = pipeline.count;
+		item.base_vertex = pipeline.base_vertex;
+		glm::vec3 position_scale = pipeline.position_scale;
+		glm::vec3 position_offset = pipeline.position_offset;
+		if (!drawable.lods.empty()) {
+			glm::vec3 center = object_to_world * glm::vec4(0.5f * (drawable.min + drawable.max), 1.0f);
+			float scale = std::max(glm::length(object_to_world[0]), std::max(glm::length(object_to_world[1]), glm::length(object_to_world[2])));
+			float radius = scale * 0.5f * glm::length(drawable.max - drawable.min);
+			//clip-space w is the distance along the view direction; clip-space y over w is [-1,1] over the screen's height:
+			float w = glm::dot(glm::vec4(center, 1.0f), glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]));
+			float y_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+			if (w > radius) { //(if the camera is inside the bounding sphere, keep full detail)
+				float screen_size = radius * y_scale / w;
+				for (auto const &lod : drawable.lods) {
+					if (screen_size >= lod.max_screen_size) break;
+					item.start = lod.start;
+					item.count = lod.count;
+					item.base_vertex = lod.base_vertex;
+					position_scale = lod.position_scale;
+					position_offset = lod.position_offset;
+				}
+			}
+		}
 
-		//Configure program uniforms:
+		//sort key: [program : 16][material : 32][vao : 16]
+		// (GL names are small integers, so their low bits are enough to group draws -- and materials, which fix the program, keep all 32 bits of their slot;
+		//  materials come before vertex arrays since applying one -- uniforms and textures -- costs more than binding a vertex array)
+		item.key = (uint64_t(material->program & 0xffff) << 48)
+		         | (uint64_t(depth_material ? 0 : pipeline.material.index) << 16)
+		         | uint64_t(vao & 0xffff);
+		//depth is the clip-space w of the drawable's origin (positive floats sort the same as their bits):
+		float w = object_to_clip[3][3];
+		item.depth = 0;
+		if (w > 0.0f) std::memcpy(&item.depth, &w, sizeof(item.depth));
+
+		//drawables that could be instanced also sort by draw range, so drawables of the same mesh end up next to each other:
+		// (+1 keeps them apart from the drawables that can't be, which all have range_key 0)
+		if (material->object_block) {
+			item.range_key = ((uint64_t(item.start) << 32) | uint64_t(uint32_t(item.base_vertex))) + 1;
+		}
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		//the matrices the drawable's program needs (as uniforms or object data):
+		ObjectData &object = draw_objects[index];
+
+		//(quantized) positions are decoded to object space as part of the position matrices:
+		glm::mat4x3 position_to_world = object_to_world;
+		if (position_scale != glm::vec3(1.0f) || position_offset != glm::vec3(0.0f)) {
+			glm::mat4 decode = glm::mat4(
+				glm::vec4(position_scale.x, 0.0f, 0.0f, 0.0f),
+				glm::vec4(0.0f, position_scale.y, 0.0f, 0.0f),
+				glm::vec4(0.0f, 0.0f, position_scale.z, 0.0f),
+				glm::vec4(position_offset, 1.0f)
+			);
+			position_to_world = object_to_world * decode;
+		}
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+		object.object_to_clip = world_to_clip * glm::mat4(position_to_world);
+
+		//OBJECT_TO_LIGHT takes vertices from object space to light space:
+		glm::mat4x3 position_to_light = world_to_light * glm::mat4(position_to_world);
+		for (uint32_t c = 0; c < 4; ++c) object.object_to_light[c] = glm::vec4(position_to_light[c], 0.0f);
+
+		//NORMAL_TO_LIGHT takes normals from object space to light space:
+		glm::mat3 object_to_light = glm::mat3(world_to_light * glm::mat4(object_to_world));
+		glm::mat3 normal_to_light;
+		//when object_to_light is a rotation times a uniform scale s (the usual case), its inverse transpose is just object_to_light / s^2:
+		float s2 = glm::dot(object_to_light[0], object_to_light[0]);
+		float tolerance = 1e-5f * s2;
+		if (s2 > 0.0f
+		 && std::abs(glm::dot(object_to_light[1], object_to_light[1]) - s2) <= tolerance
+		 && std::abs(glm::dot(object_to_light[2], object_to_light[2]) - s2) <= tolerance
+		 && std::abs(glm::dot(object_to_light[0], object_to_light[1])) <= tolerance
+		 && std::abs(glm::dot(object_to_light[0], object_to_light[2])) <= tolerance
+		 && std::abs(glm::dot(object_to_light[1], object_to_light[2])) <= tolerance) {
+			normal_to_light = object_to_light * (1.0f / s2);
+		} else {
+			normal_to_light = glm::inverse(glm::transpose(object_to_light));
 		}
+		for (uint32_t c = 0; c < 3; ++c) object.normal_to_light[c] = glm::vec4(normal_to_light[c], 0.0f);
+	};
+	std::vector< DrawStats > chunk_stats(chunks);
+	Jobs::parallel_for(chunks, [&](uint32_t chunk) {
+		uint32_t end = std::min(uint32_t(entries.size()), (chunk + 1) * DrawChunkSize);
+		for (uint32_t index = chunk * DrawChunkSize; index < end; ++index) {
+			gather(index, chunk_stats[chunk]);
+		}
+	});
+
+	for (DrawStats const &stats : chunk_stats) {
+		draw_stats.tested += stats.tested;
+		draw_stats.culled += stats.culled;
+	}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+	//...and drop the culled drawables' slots (leaving draw_queue in the order of entries):
+	draw_queue.erase(std::remove_if(draw_queue.begin(), draw_queue.end(), [](DrawItem const &item) {
+		return item.drawable == nullptr;
+	}), draw_queue.end());
+
+	//Sort, so that drawables with the same state are drawn together (front-to-back within each group):
+	if (sort_drawables) {
+		//(ties keep the order of 'drawables')
+		std::sort(draw_queue.begin(), draw_queue.end(), [](DrawItem const &a, DrawItem const &b) {
+			if (a.key != b.key) return a.key < b.key;
+			if (a.range_key != b.range_key) return a.range_key < b.range_key;
+			if (a.depth != b.depth) return a.depth < b.depth;
+			return a.order < b.order;
+		});
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	//Write the object data for items whose programs read the Objects block,
+	// combining runs of items that can share an instanced draw call (same state, same draw range):
+	object_data.clear();
+	size_t last_offset = 0; //offset of the last run's data
+	uint32_t run = 0;
+	while (run < draw_queue.size()) {
+		DrawItem &first = draw_queue[run];
+		if (!first.material->object_block) {
+			run += 1;
+			continue;
 		}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+		//(drawables with the same material share their program, textures, and uniform values)
+		Scene::Drawable::Pipeline const &pipeline = first.drawable->pipeline;
+		auto same_draw = [&first, &pipeline](DrawItem const &item) {
+			Scene::Drawable::Pipeline const &other = item.drawable->pipeline;
+			if (item.material != first.material) return false;
+			if (item.vao != first.vao || other.type != pipeline.type || other.index_type != pipeline.index_type) return false;
+			if (item.start != first.start || item.count != first.count || item.base_vertex != first.base_vertex) return false;
+			return true;
+		};
+		uint32_t instances = 1;
+		while (run + instances < draw_queue.size() && instances < MaxObjects && same_draw(draw_queue[run + instances])) {
+			instances += 1;
 		}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+		//uniform buffer ranges must start at a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT:
+		static GLint alignment = [](){
+			GLint ret = 0;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ret);
+			return std::max(ret, GLint(16));
+		}();
+		size_t offset = (object_data.size() + alignment - 1) / alignment * alignment;
+		object_data.resize(offset + instances * sizeof(ObjectData));
+
+		first.object_offset = GLintptr(offset);
+		last_offset = offset;
+		for (uint32_t j = 0; j < instances; ++j) {
+			DrawItem &item = draw_queue[run + j];
+			item.instances = (j == 0 ? instances : 0);
+			std::memcpy(object_data.data() + offset + j * sizeof(ObjectData), &draw_objects[item.order], sizeof(ObjectData));
+		}
+
+		run += instances;
+	}
+	//each draw binds a whole OBJECTS[MaxObjects] array's worth of buffer (as the block declares), so pad past the last run:
+	// (earlier runs' windows overlap the runs after them, which is fine -- a draw only reads its own instances)
+	if (!object_data.empty()) {
+		object_data.resize(std::max(object_data.size(), last_offset + MaxObjects * sizeof(ObjectData)), 0);
+	}
+
+	//Upload the frame data and all of the object data, once each:
+	// (buffers are shared by every scene, and re-specified each draw so the driver can hand back fresh storage rather than wait on the last draw's)
+	static GLuint frame_buffer = 0;
+	static GLuint object_buffer = 0;
+	if (frame_buffer == 0) glGenBuffers(1, &frame_buffer);
+	if (object_buffer == 0) glGenBuffers(1, &object_buffer);
+
+	{
+		FrameData frame;
+		frame.world_to_clip = world_to_clip;
+		for (uint32_t c = 0; c < 4; ++c) frame.world_to_light[c] = glm::vec4(world_to_light[c], 0.0f);
+		//(the payload follows the camera matrices; padded out to a whole vec4, as std140 block sizes are,
+		// and with zeros out to the largest Frame block of the programs being drawn)
+		size_t size = sizeof(frame) + frame_payload.size();
+		GLuint last_program = 0;
+		for (DrawItem const &item : draw_queue) {
+			if (item.material->program == last_program) continue;
+			last_program = item.material->program;
+			size = std::max(size, size_t(frame_block_size(last_program)));
+		}
+		std::vector< char > &frame_data = buffers.frame_data;
+		frame_data.assign((size + 15) / 16 * 16, 0);
+		std::memcpy(frame_data.data(), &frame, sizeof(frame));
+		if (!frame_payload.empty()) std::memcpy(frame_data.data() + sizeof(frame), frame_payload.data(), frame_payload.size());
+		glBindBuffer(GL_UNIFORM_BUFFER, frame_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, frame_data.size(), frame_data.data(), GL_STREAM_DRAW);
+	}
+	if (!object_data.empty()) {
+		glBindBuffer(GL_UNIFORM_BUFFER, object_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, object_data.size(), object_data.data(), GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameBinding, frame_buffer);
+
+	//Then, send each item to OpenGL, only changing state that differs from the item before:
+	GLuint bound_program = 0;
+	Material const *bound_material = nullptr;
+	GLuint bound_vao = 0;
+	GLuint active_texture = 0;
+	Material::TextureInfo bound_textures[Material::TextureCount];
+
+	for (DrawItem const &item : draw_queue) {
+		//skip items drawn by an earlier item's instanced draw:
+		if (item.instances == 0) continue;
+
+		Scene::Drawable::Pipeline const &pipeline = item.drawable->pipeline;
+		Material const &material = *item.material;
+
+		//Apply the material (shader program, uniform values, and textures), if it isn't already:
+		if (&material != bound_material) {
+			if (material.program != bound_program) {
+				glUseProgram(material.program);
+				bound_program = material.program;
+				draw_stats.program_changes += 1;
+			}
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+			//(uniform values belong to the program, and another material may have set them since)
+			material.apply();
+
+			//set up textures (units the material doesn't use are left empty, as if textures were un-bound after each draw):
+			for (uint32_t i = 0; i < Material::TextureCount; ++i) {
+				Material::TextureInfo const &want = material.textures[i];
+				Material::TextureInfo &have = bound_textures[i];
+				if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+				if (active_texture != i) {
+					glActiveTexture(GL_TEXTURE0 + i);
+					active_texture = i;
+				}
+				if (have.texture != 0 && (want.texture == 0 || have.target != want.target)) glBindTexture(have.target, 0);
+				if (want.texture != 0) glBindTexture(want.target, want.texture);
+				have = want;
+				draw_stats.texture_changes += 1;
 			}
+
+			bound_material = &material;
+			draw_stats.material_changes += 1;
 		}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		//Set attribute sources:
+		if (item.vao != bound_vao) {
+			glBindVertexArray(item.vao);
+			bound_vao = item.vao;
+			draw_stats.vao_changes += 1;
+		}
+
+		//Configure program uniforms:
+		if (material.object_block) {
+			//point the program's Objects block at this item's object data:
+			glBindBufferRange(GL_UNIFORM_BUFFER, ObjectsBinding, object_buffer, item.object_offset, MaxObjects * sizeof(ObjectData));
+		} else {
+			ObjectData const &object = draw_objects[item.order];
+			if (material.OBJECT_TO_CLIP_mat4 != -1U) {
+				glUniformMatrix4fv(material.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object.object_to_clip));
+			}
+			if (material.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				glm::mat4x3 position_to_light(glm::vec3(object.object_to_light[0]), glm::vec3(object.object_to_light[1]), glm::vec3(object.object_to_light[2]), glm::vec3(object.object_to_light[3]));
+				glUniformMatrix4x3fv(material.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(position_to_light));
+			}
+			if (material.NORMAL_TO_LIGHT_mat3 != -1U) {
+				glm::mat3 normal_to_light(glm::vec3(object.normal_to_light[0]), glm::vec3(object.normal_to_light[1]), glm::vec3(object.normal_to_light[2]));
+				glUniformMatrix3fv(material.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+			}
+		}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+		//draw the object (or objects):
+		if (item.instances > 1) {
+			if (pipeline.index_type != GL_NONE) {
+				GLsizeiptr index_size = (pipeline.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+				glDrawElementsInstancedBaseVertex(pipeline.type, item.count, pipeline.index_type, (GLbyte *)0 + item.start * index_size, item.instances, item.base_vertex);
+			} else {
+				glDrawArraysInstanced(pipeline.type, item.start, item.count, item.instances);
 			}
+			draw_stats.instanced_draws += 1;
+			draw_stats.instances += item.instances;
+		} else if (pipeline.index_type != GL_NONE) {
+			GLsizeiptr index_size = (pipeline.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			glDrawElementsBaseVertex(pipeline.type, item.count, pipeline.index_type, (GLbyte *)0 + item.start * index_size, item.base_vertex);
+		} else {
+			glDrawArrays(pipeline.type, item.start, item.count);
 		}
-		glActiveTexture(GL_TEXTURE0);
+		draw_stats.draws += 1;
+	}
 
+	//un-bind textures:
+	for (uint32_t i = 0; i < Material::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound_textures[i].target, 0);
+		}
 	}
+	glActiveTexture(GL_TEXTURE0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameBinding, 0);
+	if (!object_data.empty()) glBindBufferBase(GL_UNIFORM_BUFFER, ObjectsBinding, 0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -167,12 +573,32 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 
 
 void Scene::load(std::string const &filename,
-	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
-
-	std::ifstream file(filename, std::ios::binary);
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable,
+	uint32_t parts) {
+
+	//chunks are read directly from the mapped file (no intermediate copies):
+	ChunkFile file(filename);
+
+	//locate the main chunks:
+	// (if the file has a chunk directory, this doesn't touch the rest of the file, so skipped parts are never paged in)
+	// (only chunks for the requested parts must be present; the others are skipped if they are there)
+	auto locate = [&](char const *magic, bool required) {
+		ChunkFile::Chunk chunk;
+		if (!file.find(magic, &chunk)) {
+			if (required) throw std::runtime_error("scene file '" + filename + "' has no '" + std::string(magic) + "' chunk.");
+			return chunk;
+		}
+		//extra chunks (if any) come after all of the main chunks:
+		if (chunk.offset + chunk.info.stored > file.offset) file.seek_past(chunk);
+		return chunk;
+	};
+	ChunkFile::Chunk names_chunk = locate("str0", true);
+	ChunkFile::Chunk hierarchy_chunk = locate("xfh0", true);
+	ChunkFile::Chunk meshes_chunk = locate("msh0", parts & LoadDrawables);
+	ChunkFile::Chunk cameras_chunk = locate("cam0", parts & LoadCameras);
+	ChunkFile::Chunk lights_chunk = locate("lmp0", parts & LoadLights);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkFile::Span< char > names = file.read< char >(names_chunk);
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +609,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkFile::Span< HierarchyEntry > hierarchy = file.read< HierarchyEntry >(hierarchy_chunk);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +617,8 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkFile::Span< MeshEntry > meshes;
+	if (parts & LoadDrawables) meshes = file.read< MeshEntry >(meshes_chunk);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +627,8 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	ChunkFile::Span< CameraEntry > cameras;
+	if (parts & LoadCameras) cameras = file.read< CameraEntry >(cameras_chunk);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +639,8 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	ChunkFile::Span< LightEntry > lights;
+	if (parts & LoadLights) lights = file.read< LightEntry >(lights_chunk);
 
 
 	//--------------------------------
@@ -225,8 +650,7 @@ void Scene::load(std::string const &filename,
 	hierarchy_transforms.reserve(hierarchy.size());
 
 	for (auto const &h : hierarchy) {
-		transforms.emplace_back();
-		Transform *t = &transforms.back();
+		Transform *t = &transforms.emplace();
 		if (h.parent != -1U) {
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
@@ -235,7 +659,7 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name = Name(std::string_view(names.data() + h.name_begin, h.name_end - h.name_begin));
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -247,6 +671,7 @@ void Scene::load(std::string const &filename,
 		hierarchy_transforms.emplace_back(t);
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
+	index_transforms();
 
 	for (auto const &m : meshes) {
 		if (m.transform >= hierarchy_transforms.size()) {
@@ -271,8 +696,7 @@ void Scene::load(std::string const &filename,
 			std::cout << "Ignoring non-perspective camera (" + std::string(c.type, 4) + ") stored in file." << std::endl;
 			continue;
 		}
-		this->cameras.emplace_back(hierarchy_transforms[c.transform]);
-		Camera *camera = &this->cameras.back();
+		Camera *camera = &this->cameras.emplace(hierarchy_transforms[c.transform]);
 		camera->fovy = c.data / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 		camera->near = c.clip_near;
 		//N.b. far plane is ignored because cameras use infinite perspective matrices.
@@ -294,28 +718,38 @@ void Scene::load(std::string const &filename,
 			std::cout << "Ignoring unrecognized lamp type (" + std::string(&l.type, 1) + ") stored in file." << std::endl;
 			continue;
 		}
-		this->lights.emplace_back(hierarchy_transforms[l.transform]);
-		Light *light = &this->lights.back();
+		Light *light = &this->lights.emplace(hierarchy_transforms[l.transform]);
 		light->type = static_cast<Light::Type>(l.type);
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
-
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
+	if (parts & LoadExtra) {
+		load_extra_chunks(file, std::vector< char >(names.begin(), names.end()), hierarchy_transforms);
 	}
+}
 
+void Scene::load_extra_chunks(ChunkFile &file, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) {
+	//load_extra reads from a stream, so wrap the rest of the mapping in one:
+	struct MappedBuf : std::streambuf {
+		MappedBuf(char const *begin, char const *end) {
+			setg(const_cast< char * >(begin), const_cast< char * >(begin), const_cast< char * >(end));
+		}
+	} extra_buf(file.remaining_begin(), file.remaining_end());
+	std::istream extra(&extra_buf);
 
+	load_extra(extra, str0, xfh0);
 
+	if (extra.peek() != EOF) {
+		std::cerr << "WARNING: trailing data in scene file '" << file.filename << "'" << std::endl;
+	}
 }
 
 //-------------------------
 
-Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
-	load(filename, on_drawable);
+Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable, uint32_t parts) {
+	load(filename, on_drawable, parts);
 }
 
 Scene::Scene(Scene const &other) {
@@ -340,15 +774,15 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	//Copy transforms and store mapping:
 	transforms.clear();
 	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		Transform &copy = transforms.emplace();
+		copy.name = t.name;
+		copy.position = t.position;
+		copy.rotation = t.rotation;
+		copy.scale = t.scale;
+		copy.parent = t.parent; //will update later
 
 		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
+		auto ret = transform_to_transform.insert(std::make_pair(&t, &copy));
 		assert(ret.second);
 	}
 
@@ -357,6 +791,9 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		t.parent = transform_to_transform.at(t.parent);
 	}
 
+	sort_drawables = other.sort_drawables;
+	frame_payload = other.frame_payload;
+
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
@@ -374,4 +811,20 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	for (auto &l : lights) {
 		l.transform = transform_to_transform.at(l.transform);
 	}
+
+	index_transforms();
+}
+
+void Scene::index_transforms() {
+	transform_names.clear();
+	transform_names.reserve(transforms.size());
+	for (auto &t : transforms) {
+		transform_names.emplace(t.name, &t); //(doesn't replace, so the first transform with a name wins)
+	}
+}
+
+Scene::Transform *Scene::find_transform(Name const &name) const {
+	auto f = transform_names.find(name);
+	if (f == transform_names.end()) return nullptr;
+	return f->second;
 }
@@ -11,21 +11,29 @@
  */
 
 #include "GL.hpp"
+#include "Name.hpp"
+#include "Pool.hpp"
+#include "Material.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <type_traits>
+#include <cstdint>
+
+struct ChunkFile;
+struct Mesh;
 
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		// (interned -- see Name.hpp -- so transforms don't each allocate a string)
+		Name name;
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -40,6 +48,7 @@ struct Scene {
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		// (cached -- see 'cache' below -- so these only rebuild matrices when something they depend on has changed)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
@@ -47,6 +56,25 @@ struct Scene {
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
 		Transform() = default;
+
+		//Cached world matrices, along with the values they were built from:
+		// the cache is checked against position, rotation, scale, and parent (and the parent's cache) on use,
+		// so code can keep writing those members directly; the check is a few compares per ancestor rather than a matrix product.
+		// (not safe to use from several threads at once, since checking may rebuild ancestors' caches)
+		struct Cache {
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint32_t parent_stamp = 0; //parent's stamp when built
+
+			uint32_t stamp = 0; //new (unique) value every time the matrices are rebuilt; 0 means never built
+			glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+			glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+		};
+		mutable Cache cache;
+		//rebuild the cache (and any ancestor's) if it is out of date:
+		void update_cache() const;
 	};
 
 	struct Drawable {
@@ -56,29 +84,47 @@ struct Scene {
 
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
-			GLuint program = 0; //shader program; passed to glUseProgram
+			//shader program, textures, and uniform values (shared with other drawables -- see Material.hpp):
+			Material::Handle material;
 
 			//attributes:
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
+			GLuint depth_vao = 0; //(optional) the same, made for a position-only program, used by draw_depth -- see DepthProgram.hpp
 
 			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
-			//uniforms:
-			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
-			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
-			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
-
-			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
+			//indexed drawing (vao must have an element array buffer bound):
+			GLenum index_type = GL_NONE; //if not GL_NONE, type of indices; start, count are in indices and draws use glDrawElementsBaseVertex
+			GLint base_vertex = 0; //added to each index; passed to glDrawElementsBaseVertex
 
-			//texture objects to bind for the first TextureCount textures:
-			enum : uint32_t { TextureCount = 4 };
-			struct TextureInfo {
-				GLuint texture = 0;
-				GLenum target = GL_TEXTURE_2D;
-			} textures[TextureCount];
+			//quantized meshes store positions relative to their bounds (see MeshBuffer::LayoutQuantized):
+			// position = position_offset + position_scale * (stored position); draw() folds this into the position matrices
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
 		} pipeline;
+
+		//Levels of detail: cheaper draw ranges to use in place of pipeline's when the drawable is small on screen.
+		//(every other part of the pipeline -- material, vao -- is shared)
+		struct LOD {
+			float max_screen_size = 0.0f; //use this level when the projected bounding sphere is smaller than this (as a fraction of screen height)
+			GLuint start = 0, count = 0; //as in Pipeline
+			GLint base_vertex = 0;
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
+		};
+		std::vector< LOD > lods; //from most to least detailed (decreasing max_screen_size)
+
+		//object-space bounds, used to skip drawing when outside the view and to estimate the drawable's size on screen (for lods):
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		bool has_bounds = false; //if not set, min and max are ignored and the drawable is always drawn
+
+		//copy a mesh's draw range, encoding, bounds, and levels of detail into this drawable:
+		// (each level of detail is used below half the screen size of the one before, starting from LODScreenSize)
+		static constexpr float LODScreenSize = 0.5f;
+		void set_mesh(Mesh const &mesh);
 	};
 
 	struct Camera {
@@ -93,6 +139,8 @@ struct Scene {
 		float near = 0.01f; //near plane
 		//computed from the above:
 		glm::mat4 make_projection() const;
+		//(the same projection from explicit parameters; also used by IndexedScene::Camera)
+		static glm::mat4 make_projection(float fovy, float aspect, float near);
 	};
 
 	struct Light {
@@ -117,10 +165,21 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (in pools -- see Pool.hpp -- so objects don't move, erasing them is cheap, and walking them is a walk through arrays;
+	//  use transforms.handle(t) etc for a handle that can be checked after the object is erased)
+	// note: erasing a transform doesn't clear pointers to it (parent, transform) in other objects
+	Pool< Transform > transforms;
+	Pool< Drawable > drawables;
+	Pool< Camera > cameras;
+	Pool< Light > lights;
+
+	//transforms by name (the first in 'transforms' order, if several share a name):
+	// kept up to date by load() and set(); call index_transforms() after adding or renaming transforms yourself
+	std::unordered_map< Name, Transform *, Name::Hash > transform_names;
+	void index_transforms();
+
+	//look up a transform by name (using transform_names); returns nullptr if there is no such transform:
+	Transform *find_transform(Name const &name) const;
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
@@ -128,22 +187,153 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//depth pre-pass (or shadow map): draw every drawable that has a pipeline.depth_vao with one material (e.g. depth_program_material) through that vao:
+	// (culling and levels of detail match draw(), so a following draw() with glDepthFunc(GL_LEQUAL) shades only visible surfaces; counts go to draw_stats)
+	void draw_depth(Camera const &camera, Material::Handle const &material) const;
+	void draw_depth(glm::mat4 const &world_to_clip, Material::Handle const &material) const;
+
+	//extra per-draw data for programs that read the "Frame" uniform block, which draw() places right after the camera matrices (see FrameData):
+	// (Scene doesn't look inside it -- each program says what it expects here, e.g. LitColorTextureProgram::FrameLight;
+	//  draw() zero-fills whatever a program's block has past the payload, so an unset payload reads as zeros)
+	std::vector< char > frame_payload;
+	//(set frame_payload to a copy of a struct laid out to match the program's block)
+	template< typename T >
+	void set_frame_payload(T const &payload) {
+		static_assert(std::is_trivially_copyable< T >::value, "Frame payload is copied as bytes.");
+		frame_payload.assign(reinterpret_cast< char const * >(&payload), reinterpret_cast< char const * >(&payload) + sizeof(T));
+	}
+
+	//draw() sorts drawables by the state they need (program, material, vertex array) and then front-to-back, so state changes less often:
+	// (turn this off if drawables must be drawn in list order -- e.g., if they are blended)
+	bool sort_drawables = true;
+
+	//counts from the most recent draw() call:
+	struct DrawStats {
+		uint32_t tested = 0; //drawables (with bounds) tested against the view frustum
+		uint32_t culled = 0; //...and skipped because they were outside of it
+		uint32_t draws = 0; //draw calls issued
+		uint32_t program_changes = 0; //glUseProgram calls
+		uint32_t vao_changes = 0; //glBindVertexArray calls
+		uint32_t material_changes = 0; //materials applied (uniform values set, textures bound as needed)
+		uint32_t texture_changes = 0; //texture units re-bound
+		uint32_t instanced_draws = 0; //draw calls (of those above) that drew several drawables at once
+		uint32_t instances = 0; //...and how many drawables they drew
+	};
+	mutable DrawStats draw_stats;
+
+	//draw() culls drawables, picks their levels of detail, and computes their matrices in parallel (using Jobs),
+	// in chunks of this many drawables, into a flat list; then submits the list to OpenGL from the calling thread:
+	static constexpr uint32_t DrawChunkSize = 256;
+
+	//a drawable to draw, along with its object-to-world matrix:
+	// (draw() lists 'drawables' this way; other scene storage -- e.g., IndexedScene -- can list its own and call draw_list)
+	struct DrawEntry {
+		Drawable const *drawable = nullptr; //(its transform isn't used)
+		glm::mat4x3 const *object_to_world = nullptr;
+	};
+
+	//a drawable that draw() has decided to draw, with its level of detail picked:
+	struct DrawItem {
+		uint64_t key = 0; //sort key for state (program, material, vertex array)
+		uint64_t range_key = 0; //draw range, for drawables that can be instanced (sorted between state and depth, so they end up next to each other)
+		Drawable const *drawable = nullptr;
+		Material const *material = nullptr; //(drawable's, looked up once -- or the depth pass's)
+		GLuint vao = 0; //(pipeline.vao -- or, for a depth pass, pipeline.depth_vao)
+		uint32_t depth = 0; //clip-space w of the drawable's origin, as bits (sorted after key and range_key, front-to-back)
+		uint32_t order = 0; //position in the list of entries (to break ties in the sort, and to find the drawable's matrices)
+		GLuint start = 0, count = 0; //(as in Drawable::LOD)
+		GLint base_vertex = 0;
+		uint32_t instances = 1; //number of items, starting with this one, drawn by this item's draw call (0 if drawn by an earlier item's)
+		GLintptr object_offset = 0; //where the items' ObjectData starts in the object buffer (if the material uses object_block)
+	};
+
+	//uniform blocks that draw() fills in, laid out as programs (std140) expect:
+	// (programs should bind their blocks to these binding points with glUniformBlockBinding)
+	enum : uint32_t {
+		FrameBinding = 0,
+		ObjectsBinding = 1,
+		MaxObjects = 64, //objects per draw call (64 * sizeof(ObjectData) is under the 16k guaranteed block size)
+	};
+
+	//per-draw() data:
+	//   layout(std140) uniform Frame {
+	//     mat4 WORLD_TO_CLIP; mat4x3 WORLD_TO_LIGHT;
+	//     ...then the program's own members, filled from frame_payload
+	//   };
+	struct FrameData {
+		glm::mat4 world_to_clip = glm::mat4(1.0f);
+		glm::vec4 world_to_light[4]; //(std140 pads each column of a mat4x3 to a vec4)
+	};
+	static_assert(sizeof(FrameData) == 128, "FrameData matches std140 layout (and ends on a 16-byte boundary, so a payload laid out as its own std140 struct lines up).");
+
+	//per-object data:
+	//   struct Object { mat4 OBJECT_TO_CLIP; mat4x3 OBJECT_TO_LIGHT; mat3 NORMAL_TO_LIGHT; };
+	//   layout(std140) uniform Objects { Object OBJECTS[MaxObjects]; };
+	// (each draw binds the whole MaxObjects-long array, of which it reads the first 'instances' entries)
+	struct ObjectData {
+		glm::mat4 object_to_clip = glm::mat4(1.0f);
+		glm::vec4 object_to_light[4]; //(std140 pads each column of a mat4x3 to a vec4...)
+		glm::vec4 normal_to_light[3]; //(...and of a mat3)
+	};
+	static_assert(sizeof(ObjectData) == 176, "ObjectData matches std140 layout.");
+
+	//storage used while drawing (kept between calls so it can be reused; not copied along with the scene):
+	struct DrawBuffers {
+		std::vector< DrawEntry > list; //entries that might be drawn
+		std::vector< DrawItem > queue; //...the ones that will be, with levels of detail picked (sorted, if sorting)
+		std::vector< ObjectData > objects; //matrices for each entry in list (whether they end up in object_data or set as uniforms)
+		std::vector< char > object_data; //the Objects block contents for every draw call, as uploaded (padded so the last call's block is complete)
+		std::vector< char > frame_data; //the Frame block contents (FrameData, then the payload), as uploaded
+
+		DrawBuffers() = default;
+		DrawBuffers(DrawBuffers const &) { }
+		DrawBuffers &operator=(DrawBuffers const &) { return *this; }
+	};
+	mutable DrawBuffers draw_buffers;
+
+	//the rest of draw(), once entries are listed in buffers.list:
+	// culls, picks levels of detail, computes matrices, sorts (if sort_drawables), and sends everything to OpenGL; fills in *stats
+	// (entries without a vao or vertices, or whose material is missing or has no program, are skipped)
+	// if depth_material is set, every entry is drawn with it, through its pipeline.depth_vao (as in draw_depth)
+	static void draw_list(DrawBuffers &buffers, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light,
+		bool sort_drawables, std::vector< char > const &frame_payload, DrawStats *stats, Material const *depth_material = nullptr);
+	//list every drawable (and its world matrix) in draw_buffers.list, bringing transforms up to date (used by draw and draw_depth):
+	void list_drawables() const;
+
+	//parts of a scene file that load() can read:
+	// (transforms are always loaded; skipping the rest is quicker, especially for files with a chunk directory)
+	// (a file only needs the chunks that the requested parts read -- e.g., LoadHierarchy needs just names and transforms)
+	enum LoadParts : uint32_t {
+		LoadHierarchy = 0, //just the transforms
+		LoadDrawables = 1, //call on_drawable for each mesh
+		LoadCameras = 2,
+		LoadLights = 4,
+		LoadExtra = 8, //call load_extra_chunks
+		LoadEverything = LoadDrawables | LoadCameras | LoadLights | LoadExtra,
+	};
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
+	// 'parts' is a combination of LoadParts flags
 	// throws on file format errors
 	void load(std::string const &filename,
-		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
+		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr,
+		uint32_t parts = LoadEverything
 	);
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
 	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
+	//...or override this version to fetch just the extra chunks you need (e.g., with file.find()):
+	// (the default implementation hands the data after the main chunks to load_extra)
+	virtual void load_extra_chunks(ChunkFile &file, std::vector< char > const &str0, std::vector< Transform * > const &xfh0);
+
 	//empty scene:
 	Scene() = default;
 
 	//load a scene:
-	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
+	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable, uint32_t parts = LoadEverything);
 
 	//copy a scene (with proper pointer fixup):
 	Scene(Scene const &); //...as a constructor
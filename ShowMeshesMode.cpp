@@ -6,28 +6,25 @@
 #include <iostream>
 
 ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
+	for (auto const &[name, mesh] : buffer.meshes) {
+		meshes.emplace(name.str(), &mesh);
+	}
+
 	vao = buffer.make_vao_for_program(show_meshes_program->program);
 
 	//Set up scene:
 	{ //create a single camera:
-		scene.transforms.emplace_back();
-		scene.cameras.emplace_back(&scene.transforms.back());
-		scene_camera = &scene.cameras.back();
+		scene_camera = &scene.cameras.emplace(&scene.transforms.emplace());
 		scene_camera->fovy = 60.0f / 180.0f * 3.1415926f;
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
 	}
 	{ //create a drawable to hold the current mesh:
-		scene.transforms.emplace_back();
-		scene.drawables.emplace_back(&scene.transforms.back());
-		scene_drawable = &scene.drawables.back();
+		scene_drawable = &scene.drawables.emplace(&scene.transforms.emplace());
 
 		scene_drawable->pipeline = show_meshes_program_pipeline;
 		scene_drawable->pipeline.vao = vao;
-		//these will be updated by the mesh selection code:
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		//(mesh range will be set by select_mesh)
 	}
 
 	//select first mesh in buffer:
@@ -152,51 +149,37 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) --f;
-	if (f == buffer.meshes.end()) f = buffer.meshes.begin();
+	auto f = meshes.find(current_mesh_name);
+	if (f != meshes.end()) --f;
+	if (f == meshes.end()) f = meshes.begin();
 
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
-	} else {
-		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
-		current_mesh_min = glm::vec3(0.0f);
-		current_mesh_max = glm::vec3(0.0f);
-	}
+	select_mesh(f);
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) ++f;
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
+	auto f = meshes.find(current_mesh_name);
+	if (f != meshes.end()) ++f;
+	if (f == meshes.end()) {
+		auto temp = meshes.rbegin();
+		if (temp != meshes.rend()) {
 			++temp;
 			f = temp.base();
-			assert(f != buffer.meshes.end());
+			assert(f != meshes.end());
 		}
 	}
 
-	if (f != buffer.meshes.end()) {
+	select_mesh(f);
+}
+
+void ShowMeshesMode::select_mesh(std::map< std::string, Mesh const * >::const_iterator f) {
+	if (f != meshes.end()) {
 		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+		scene_drawable->set_mesh(*f->second);
+		current_mesh_min = f->second->min;
+		current_mesh_max = f->second->max;
 	} else {
 		current_mesh_name = "";
-		scene_drawable->pipeline.type = GL_TRIANGLES;
-		scene_drawable->pipeline.start = 0;
-		scene_drawable->pipeline.count = 0;
+		scene_drawable->set_mesh(Mesh()); //(no vertices)
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
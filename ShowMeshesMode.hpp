@@ -11,6 +11,9 @@
 #include "Scene.hpp"
 #include "Mesh.hpp"
 
+#include <map>
+#include <string>
+
 struct ShowMeshesMode : Mode {
 	ShowMeshesMode(MeshBuffer const &buffer);
 	virtual ~ShowMeshesMode();
@@ -29,6 +32,8 @@ struct ShowMeshesMode : Mode {
 
 	//MeshBuffer being viewed:
 	MeshBuffer const &buffer;
+	//...its meshes, sorted by name (for stepping through with the arrow keys):
+	std::map< std::string, Mesh const * > meshes;
 
 	//currently selected mesh:
 	std::string current_mesh_name = "";
@@ -36,6 +41,8 @@ struct ShowMeshesMode : Mode {
 	glm::vec3 current_mesh_max = glm::vec3(0.0f);
 	void select_prev_mesh();
 	void select_next_mesh();
+	//point scene_drawable (and the current_mesh_* fields) at a mesh, or at nothing if f is meshes.end():
+	void select_mesh(std::map< std::string, Mesh const * >::const_iterator f);
 	
 	//Vertex array object used to bind mesh buffer for drawing:
 	GLuint vao = 0;
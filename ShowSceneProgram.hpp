@@ -15,7 +15,7 @@ struct ShowSceneProgram {
 
 	//Attribute (per-vertex variable) locations:
 	GLuint Position_vec4 = -1U;
-	GLuint Normal_vec3 = -1U;
+	GLuint Normal_vec4 = -1U;
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
 
@@ -31,4 +31,4 @@ struct ShowSceneProgram {
 };
 
 extern Load< ShowSceneProgram > show_scene_program;
-extern Scene::Drawable::Pipeline show_scene_program_pipeline; //Drawable::Pipeline already initialized with proper uniform locations for this program.
+extern Scene::Drawable::Pipeline show_scene_program_pipeline; //Drawable::Pipeline already initialized with a material for this program (with proper uniform locations).
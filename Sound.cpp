@@ -5,6 +5,8 @@
 #include <SDL.h>
 
 #include <list>
+#include <atomic>
+#include <cstring>
 #include <cassert>
 #include <exception>
 #include <iostream>
@@ -23,6 +25,30 @@ namespace {
 	//list of all currently playing samples:
 	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
 
+	//one stereo output sample, as SDL expects it:
+	struct LR {
+		float l;
+		float r;
+	};
+	static_assert(sizeof(LR) == 8, "Sample is packed");
+
+	//render-ahead state (only used when init() is passed a non-zero render_ahead_blocks):
+	struct RenderAhead {
+		//single-producer (mix thread), single-consumer (audio callback) ring of mixed blocks:
+		std::vector< LR > blocks; //blocks.size() == count * MIX_SAMPLES
+		uint32_t count = 0;
+		//total blocks written/read so far; (written - read) is the number of blocks ready to play:
+		std::atomic< uint32_t > written{0};
+		std::atomic< uint32_t > read{0};
+
+		SDL_Thread *thread = nullptr;
+		SDL_sem *space = nullptr; //posted by the audio callback whenever it frees a block
+		SDL_mutex *mutex = nullptr; //taken by the mix thread while mixing (and by Sound::lock())
+		std::atomic< bool > quit{false};
+
+		std::atomic< uint32_t > underruns{0}; //blocks the callback had to fill with silence
+	} render_ahead;
+
 }
 
 //public-facing data:
@@ -36,24 +62,34 @@ Sound::Listener Sound::listener;
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//...as is the render-ahead version and the thread that feeds it:
+void copy_audio(void *, Uint8 *buffer_, int len);
+int mix_thread(void *);
+
 //------------------------ public-facing --------------------------------
 
 Sound::Sample::Sample(std::string const &filename) {
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
+		load_wav(filename, &data, &channels);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		load_opus(filename, &data, &channels);
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".wav\" or \".opus\" -- unsure how to load.");
 	}
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data_, uint32_t channels_) : data(data_), channels(channels_) {
+	if (channels != 1 && channels != 2) {
+		throw std::runtime_error("Samples must be mono or stereo, not " + std::to_string(channels) + "-channel.");
+	}
+	if (data.size() % channels != 0) {
+		throw std::runtime_error("Stereo sample data must contain an even number of values.");
+	}
 }
 
 
 
-void Sound::init() {
+void Sound::init(uint32_t render_ahead_blocks) {
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -67,17 +103,41 @@ void Sound::init() {
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
 	want.samples = MIX_SAMPLES;
-	want.callback = mix_audio;
+	want.callback = (render_ahead_blocks ? copy_audio : mix_audio);
 
 	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
-	} else {
-		//start audio playback:
-		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		return;
+	}
+
+	if (render_ahead_blocks) {
+		render_ahead.count = render_ahead_blocks;
+		render_ahead.blocks.assign(render_ahead.count * MIX_SAMPLES, LR{0.0f, 0.0f});
+		render_ahead.written = 0;
+		render_ahead.read = 0;
+		render_ahead.quit = false;
+		render_ahead.space = SDL_CreateSemaphore(0);
+		render_ahead.mutex = SDL_CreateMutex();
+		if (render_ahead.space && render_ahead.mutex) {
+			render_ahead.thread = SDL_CreateThread(mix_thread, "Sound mix", nullptr);
+		}
+		if (!render_ahead.thread) {
+			std::cerr << "Failed to start render-ahead mix thread:\n" << SDL_GetError() << std::endl;
+			std::cerr << "  (Will continue without audio.)\n" << std::endl;
+			shutdown();
+			return;
+		}
+	}
+
+	//start audio playback:
+	SDL_PauseAudioDevice(device, 0);
+	std::cout << "Audio output initialized";
+	if (render_ahead.thread) {
+		std::cout << " (rendering " << render_ahead.count << " blocks ahead)";
 	}
+	std::cout << "." << std::endl;
 }
 
 
@@ -88,15 +148,36 @@ void Sound::shutdown() {
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+
+	if (render_ahead.thread) {
+		//ask mix thread to exit, wake it up in case it is waiting for space, and wait for it:
+		render_ahead.quit = true;
+		SDL_SemPost(render_ahead.space);
+		SDL_WaitThread(render_ahead.thread, nullptr);
+		render_ahead.thread = nullptr;
+		if (render_ahead.underruns) {
+			std::cerr << "NOTE: render-ahead mixer underran " << render_ahead.underruns << " times." << std::endl;
+		}
+	}
+	if (render_ahead.space) {
+		SDL_DestroySemaphore(render_ahead.space);
+		render_ahead.space = nullptr;
+	}
+	if (render_ahead.mutex) {
+		SDL_DestroyMutex(render_ahead.mutex);
+		render_ahead.mutex = nullptr;
+	}
 }
 
 
 void Sound::lock() {
-	if (device) SDL_LockAudioDevice(device);
+	if (render_ahead.mutex) SDL_LockMutex(render_ahead.mutex);
+	else if (device) SDL_LockAudioDevice(device);
 }
 
 void Sound::unlock() {
-	if (device) SDL_UnlockAudioDevice(device);
+	if (render_ahead.mutex) SDL_UnlockMutex(render_ahead.mutex);
+	else if (device) SDL_UnlockAudioDevice(device);
 }
 
 std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float pan, float volume) {
@@ -219,6 +300,34 @@ inline void compute_pan_weights(float pan, float *left, float *right) {
 	*right = std::sin(ang);
 }
 
+//helper: balance (used instead of panning for stereo samples)
+inline void compute_balance_weights(float pan, float *left, float *right) {
+	//clamp pan to -1 to 1 range:
+	pan = std::max(-1.0f, std::min(1.0f, pan));
+
+	//centered balance passes both channels through; otherwise attenuate the far side:
+	*left = std::min(1.0f, 1.0f - pan);
+	*right = std::min(1.0f, 1.0f + pan);
+}
+
+//helper: mix a run of stereo frames (no wrapping or branching, so the loop can vectorize):
+// if 'point' is set, source is being positioned in 3D, so both channels go to both sides
+template< bool point >
+void mix_stereo_run(LR *buffer, float const *src, uint32_t count, LR pan, LR pan_step) {
+	for (uint32_t f = 0; f < count; ++f) {
+		float l = pan.l + float(f) * pan_step.l;
+		float r = pan.r + float(f) * pan_step.r;
+		if (point) {
+			float m = 0.5f * (src[2*f] + src[2*f+1]);
+			buffer[f].l += l * m;
+			buffer[f].r += r * m;
+		} else {
+			buffer[f].l += l * src[2*f];
+			buffer[f].r += r * src[2*f+1];
+		}
+	}
+}
+
 //helper: 3D audio panning
 void compute_pan_from_listener_and_position(
 	glm::vec3 const &listener_position,
@@ -310,18 +419,9 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 }
 
 
-//The audio callback -- invoked by SDL when it needs more sound to play:
-void mix_audio(void *, Uint8 *buffer_, int len) {
-	assert(buffer_); //should always have some audio buffer
-
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
-	LR *buffer = reinterpret_cast< LR * >(buffer_);
-
+//Mix MIX_SAMPLES of audio from all playing samples into buffer:
+// (caller is responsible for making sure this doesn't run concurrently with Sound::lock())
+void mix_block(LR *buffer) {
 	//zero the output buffer:
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		buffer[s].l = 0.0f;
@@ -359,7 +459,11 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 			step_value_ramp(playing_sample.half_volume_radius);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			if (playing_sample.channels == 2) {
+				compute_balance_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			} else {
+				compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			}
 
 			step_value_ramp(playing_sample.pan);
 		}
@@ -379,7 +483,11 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 				&end_pan.l, &end_pan.r);
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			if (playing_sample.channels == 2) {
+				compute_balance_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			} else {
+				compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			}
 		}
 
 		end_pan.l *= end_volume * playing_sample.volume.value;
@@ -391,29 +499,56 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
 		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
 
-		assert(playing_sample.i < playing_sample.data.size());
-
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
-
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
+		uint32_t frames = uint32_t(playing_sample.data.size()) / playing_sample.channels;
+		assert(playing_sample.i < frames);
+
+		if (playing_sample.channels == 1) {
+			for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
+				//mix one sample based on current pan values:
+				buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
+				buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+
+				//update position in sample:
+				playing_sample.i += 1;
+				if (playing_sample.i == playing_sample.data.size()) {
+					if (playing_sample.loop) {
+						playing_sample.i = 0;
+					} else {
+						break;
+					}
 				}
+
+				//update pan values:
+				pan.l += pan_step.l;
+				pan.r += pan_step.r;
 			}
+		} else {
+			//stereo samples are mixed in runs that end at the end of the block or the sample:
+			bool point = !(playing_sample.pan.value == playing_sample.pan.value);
+			for (uint32_t i = 0; i < MIX_SAMPLES; /* later */) {
+				uint32_t count = std::min(MIX_SAMPLES - i, frames - playing_sample.i);
+				float const *src = &playing_sample.data[2 * playing_sample.i];
+				if (point) mix_stereo_run< true >(buffer + i, src, count, pan, pan_step);
+				else mix_stereo_run< false >(buffer + i, src, count, pan, pan_step);
+
+				//update position in block and sample:
+				i += count;
+				playing_sample.i += count;
+				if (playing_sample.i == frames) {
+					if (playing_sample.loop) {
+						playing_sample.i = 0;
+					} else {
+						break;
+					}
+				}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+				//update pan values:
+				pan.l += float(count) * pan_step.l;
+				pan.r += float(count) * pan_step.r;
+			}
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
+		if (playing_sample.i >= frames
 		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
 		 	playing_sample.stopped = true;
 			//erase from list:
@@ -435,4 +570,52 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 
 }
 
+//The audio callback -- invoked by SDL when it needs more sound to play:
+void mix_audio(void *, Uint8 *buffer_, int len) {
+	assert(buffer_); //should always have some audio buffer
+	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+
+	mix_block(reinterpret_cast< LR * >(buffer_));
+}
+
+//The render-ahead audio callback -- just copies out a block that mix_thread already mixed:
+void copy_audio(void *, Uint8 *buffer_, int len) {
+	assert(buffer_); //should always have some audio buffer
+	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
 
+	uint32_t read = render_ahead.read.load(std::memory_order_relaxed);
+	if (read == render_ahead.written.load(std::memory_order_acquire)) {
+		//mix thread fell behind; play silence rather than wait:
+		std::memset(buffer_, 0, len);
+		render_ahead.underruns.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	std::memcpy(buffer_, &render_ahead.blocks[(read % render_ahead.count) * MIX_SAMPLES], len);
+	render_ahead.read.store(read + 1, std::memory_order_release);
+	SDL_SemPost(render_ahead.space);
+}
+
+//The render-ahead mix thread -- keeps the ring of mixed blocks as full as it can:
+int mix_thread(void *) {
+	//not all platforms allow this; render-ahead still helps at normal priority:
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+	while (!render_ahead.quit) {
+		uint32_t written = render_ahead.written.load(std::memory_order_relaxed);
+		if (written - render_ahead.read.load(std::memory_order_acquire) >= render_ahead.count) {
+			//ring is full; wait for the callback to consume a block:
+			// (timeout is just paranoia so that a missed wakeup can't stall audio for long)
+			SDL_SemWaitTimeout(render_ahead.space, 10);
+			continue;
+		}
+
+		SDL_LockMutex(render_ahead.mutex);
+		mix_block(&render_ahead.blocks[(written % render_ahead.count) * MIX_SAMPLES]);
+		SDL_UnlockMutex(render_ahead.mutex);
+
+		render_ahead.written.store(written + 1, std::memory_order_release);
+	}
+
+	return 0;
+}
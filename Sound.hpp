@@ -12,17 +12,19 @@
 
 namespace Sound {
 
-//Sample objects hold mono (one-channel) audio.
+//Sample objects hold mono (one-channel) or stereo (two-channel) audio.
 struct Sample {
 	//Load from a '.wav' or '.opus' file.
-	//  will warn and convert if sound is not already 48kHz mono:
+	//  will warn and convert if sound is not already 48kHz
+	//  (stereo and multi-channel files are loaded as stereo, everything else as mono):
 	Sample(std::string const &filename);
 	
-	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	//Directly supply an audio buffer (interleaved LRLR... if channels == 2):
+	Sample(std::vector< float > const &data, uint32_t channels = 1);
 
-	//sample data is stored as 48kHz, mono, floating-point:
+	//sample data is stored as 48kHz, floating-point, interleaved if stereo:
 	std::vector< float > data;
+	uint32_t channels = 1; //1 (mono) or 2 (stereo)
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -54,6 +56,7 @@ struct PlayingSample {
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
+	// (for stereo samples, pan acts as a balance control)
 	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
@@ -67,7 +70,8 @@ struct PlayingSample {
 	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
 	// may result in bad results. Instead, use the functions above, which perform locking!
 	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
+	uint32_t channels = 1; //channels in sample data (1 or 2)
+	uint32_t i = 0; //next frame (== data value for mono, LR pair for stereo) to read
 	bool loop = false; //should playback loop after data runs out?
 	bool stopping = false; //is playing stopping?
 	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
@@ -82,14 +86,19 @@ struct PlayingSample {
 	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
 
 	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
+		: data(sample_.data), channels(sample_.channels), loop(loop_), volume(volume_), pan(pan_) { }
 	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+		: data(sample_.data), channels(sample_.channels), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//call Sound::init() from main.cpp before using any member functions:
+// if render_ahead_blocks is non-zero, mixing happens on a dedicated high-priority thread
+// that stays up to render_ahead_blocks blocks (of 1024 samples) ahead of playback;
+// this adds that much latency but makes audio much less sensitive to scheduling hiccups.
+// (with render_ahead_blocks == 0, mixing happens directly in the SDL audio callback.)
+void init(uint32_t render_ahead_blocks = 0);
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
@@ -140,7 +149,7 @@ void stop_all_samples();
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
-//the audio callback doesn't run between Sound::lock() and Sound::unlock()
+//the mixer (audio callback or render-ahead thread) doesn't run between Sound::lock() and Sound::unlock()
 // the set_*/stop/play/... functions already use these helpers, so you shouldn't need
 // to call them unless your code is modifying values directly:
 void lock();
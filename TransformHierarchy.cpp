@@ -0,0 +1,141 @@
+#include "TransformHierarchy.hpp"
+#include "simd.hpp"
+
+#include <stdexcept>
+#include <string>
+
+uint32_t TransformHierarchy::add(Name const &name, uint32_t parent, glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	uint32_t index = size();
+	if (parent != -1U && parent >= index) {
+		throw std::runtime_error("Adding transform '" + name.str() + "' with parent " + std::to_string(parent) + " that isn't (yet) in the hierarchy.");
+	}
+	names.emplace_back(name);
+	parents.emplace_back(parent);
+	position_x.emplace_back(position.x);
+	position_y.emplace_back(position.y);
+	position_z.emplace_back(position.z);
+	rotation_x.emplace_back(rotation.x);
+	rotation_y.emplace_back(rotation.y);
+	rotation_z.emplace_back(rotation.z);
+	rotation_w.emplace_back(rotation.w);
+	scale_x.emplace_back(scale.x);
+	scale_y.emplace_back(scale.y);
+	scale_z.emplace_back(scale.z);
+	local_to_world.emplace_back(1.0f);
+	return index;
+}
+
+void TransformHierarchy::add(Scene const &scene, std::unordered_map< Scene::Transform const *, uint32_t > *indices_) {
+	std::unordered_map< Scene::Transform const *, uint32_t > indices_temp;
+	std::unordered_map< Scene::Transform const *, uint32_t > &indices = *(indices_ ? indices_ : &indices_temp);
+
+	//(loaded scenes are already in order, so this doesn't usually recurse)
+	struct {
+		TransformHierarchy *hierarchy;
+		std::unordered_map< Scene::Transform const *, uint32_t > *indices;
+		uint32_t operator()(Scene::Transform const *t) {
+			auto f = indices->find(t);
+			if (f != indices->end()) return f->second;
+			uint32_t parent = (t->parent ? (*this)(t->parent) : -1U);
+			uint32_t index = hierarchy->add(t->name, parent, t->position, t->rotation, t->scale);
+			indices->emplace(t, index);
+			return index;
+		}
+	} add_transform{this, &indices};
+
+	for (auto const &t : scene.transforms) {
+		add_transform(&t);
+	}
+}
+
+void TransformHierarchy::set_position(uint32_t i, glm::vec3 const &position) {
+	position_x[i] = position.x;
+	position_y[i] = position.y;
+	position_z[i] = position.z;
+}
+
+void TransformHierarchy::set_rotation(uint32_t i, glm::quat const &rotation) {
+	rotation_x[i] = rotation.x;
+	rotation_y[i] = rotation.y;
+	rotation_z[i] = rotation.z;
+	rotation_w[i] = rotation.w;
+}
+
+void TransformHierarchy::set_scale(uint32_t i, glm::vec3 const &scale) {
+	scale_x[i] = scale.x;
+	scale_y[i] = scale.y;
+	scale_z[i] = scale.z;
+}
+
+void TransformHierarchy::update() {
+	uint32_t count = size();
+	local_to_world.resize(count);
+
+	//first, local-to-parent matrices (same as Scene::Transform::make_local_to_parent), which are independent of each other:
+	uint32_t i = 0;
+
+	#if defined(HAVE_SSE)
+	//four at a time:
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(&rotation_x[i]);
+		__m128 y = _mm_loadu_ps(&rotation_y[i]);
+		__m128 z = _mm_loadu_ps(&rotation_z[i]);
+		__m128 w = _mm_loadu_ps(&rotation_w[i]);
+		__m128 sx = _mm_loadu_ps(&scale_x[i]);
+		__m128 sy = _mm_loadu_ps(&scale_y[i]);
+		__m128 sz = _mm_loadu_ps(&scale_z[i]);
+
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 two = _mm_set1_ps(2.0f);
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		//rotation matrix entries (as in glm::mat3_cast), with columns scaled:
+		// (named m<column><row>)
+		__m128 m00 = _mm_mul_ps(sx, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+		__m128 m01 = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+		__m128 m02 = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+		__m128 m10 = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+		__m128 m11 = _mm_mul_ps(sy, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+		__m128 m12 = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+		__m128 m20 = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+		__m128 m21 = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+		__m128 m22 = _mm_mul_ps(sz, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+		__m128 m30 = _mm_loadu_ps(&position_x[i]);
+		__m128 m31 = _mm_loadu_ps(&position_y[i]);
+		__m128 m32 = _mm_loadu_ps(&position_z[i]);
+
+		//a mat4x3 is twelve floats (column-major), so transposing groups of four entries gives each matrix's floats in order:
+		_MM_TRANSPOSE4_PS(m00, m01, m02, m10);
+		_MM_TRANSPOSE4_PS(m11, m12, m20, m21);
+		_MM_TRANSPOSE4_PS(m22, m30, m31, m32);
+		static_assert(sizeof(glm::mat4x3) == 12 * sizeof(float), "mat4x3 is twelve packed floats.");
+		float *out = &local_to_world[i][0][0];
+		_mm_storeu_ps(out + 0, m00); _mm_storeu_ps(out + 4, m11); _mm_storeu_ps(out + 8, m22);
+		_mm_storeu_ps(out + 12, m01); _mm_storeu_ps(out + 16, m12); _mm_storeu_ps(out + 20, m30);
+		_mm_storeu_ps(out + 24, m02); _mm_storeu_ps(out + 28, m20); _mm_storeu_ps(out + 32, m31);
+		_mm_storeu_ps(out + 36, m10); _mm_storeu_ps(out + 40, m21); _mm_storeu_ps(out + 44, m32);
+	}
+	#endif
+
+	//the rest one at a time:
+	for (; i < count; ++i) {
+		glm::mat3 rot = glm::mat3_cast(get_rotation(i));
+		local_to_world[i] = glm::mat4x3(
+			rot[0] * scale_x[i],
+			rot[1] * scale_y[i],
+			rot[2] * scale_z[i],
+			get_position(i)
+		);
+	}
+
+	//then, in order, combine with parents (which come earlier, so already hold local-to-world matrices):
+	for (i = 0; i < count; ++i) {
+		uint32_t parent = parents[i];
+		if (parent != -1U) {
+			//note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+			local_to_world[i] = local_to_world[parent] * glm::mat4(local_to_world[i]);
+		}
+	}
+}
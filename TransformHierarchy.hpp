@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * A "TransformHierarchy" stores a hierarchy of transforms as flat arrays
+ *  (one per component, i.e., "struct of arrays") in topological order --
+ *  every transform comes after its parent.
+ *
+ * This makes computing world matrices for every transform one linear pass,
+ *  with local matrices built from quaternions several at a time:
+ *
+ *   TransformHierarchy hierarchy;
+ *   hierarchy.add(scene); //(or hierarchy.add(name, parent, position, rotation, scale) for each transform)
+ *   ...
+ *   hierarchy.set_position(i, hierarchy.get_position(i) + step);
+ *   hierarchy.update();
+ *   glm::mat4x3 const &local_to_world = hierarchy.local_to_world[i];
+ *
+ * Scene files already store transforms in this order, so a loaded Scene's
+ *  transforms map onto indices directly.
+ *
+ */
+
+#include "Scene.hpp"
+#include "Name.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+struct TransformHierarchy {
+	//number of transforms:
+	uint32_t size() const { return uint32_t(parents.size()); }
+
+	//add a transform, returning its index:
+	// parent must already be in the hierarchy (or -1U for none)
+	// note: will throw if parent is out of range
+	uint32_t add(Name const &name, uint32_t parent,
+		glm::vec3 const &position = glm::vec3(0.0f),
+		glm::quat const &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		glm::vec3 const &scale = glm::vec3(1.0f)
+	);
+
+	//add all of a scene's transforms (each after its parent; otherwise in list order):
+	// if indices is given, it is filled in with the index each transform was added at
+	void add(Scene const &scene, std::unordered_map< Scene::Transform const *, uint32_t > *indices = nullptr);
+
+	//get or set a transform's local (relative to parent) position, rotation, and scale:
+	glm::vec3 get_position(uint32_t i) const { return glm::vec3(position_x[i], position_y[i], position_z[i]); }
+	glm::quat get_rotation(uint32_t i) const { return glm::quat(rotation_w[i], rotation_x[i], rotation_y[i], rotation_z[i]); }
+	glm::vec3 get_scale(uint32_t i) const { return glm::vec3(scale_x[i], scale_y[i], scale_z[i]); }
+	void set_position(uint32_t i, glm::vec3 const &position);
+	void set_rotation(uint32_t i, glm::quat const &rotation);
+	void set_scale(uint32_t i, glm::vec3 const &scale);
+
+	//recompute local_to_world for every transform:
+	void update();
+
+	//-- storage ---
+	//(all arrays have size() entries)
+
+	std::vector< Name > names;
+	std::vector< uint32_t > parents; //index of each transform's parent (always less than its own), or -1U
+
+	std::vector< float > position_x, position_y, position_z;
+	std::vector< float > rotation_x, rotation_y, rotation_z, rotation_w; //(unit quaternions)
+	std::vector< float > scale_x, scale_y, scale_z;
+
+	//computed by update():
+	std::vector< glm::mat4x3 > local_to_world;
+};
@@ -0,0 +1,52 @@
+/*
+ * index-meshes converts a '.pnct' mesh file (unindexed triangles, as written by
+ *  export-meshes.py) into a '.pnci' file, in which each mesh's duplicate vertices
+ *  are merged and its triangles are stored as 16- or 32-bit indices.
+ *
+ * '.pnci' files contain (in a chunk directory, see read_write_chunk.hpp):
+ *  "pnct" - deduplicated vertices (same layout as in '.pnct' files)
+ *  "ix16" or "ix32" - indices, relative to the first vertex of their mesh
+ *  "str0" - mesh names
+ *  "idx1" - one entry per mesh: name, vertex, and index ranges
+ *
+ * Usage:
+ *  index-meshes <in.pnct> <out.pnci>
+ */
+
+#include "MeshFile.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct> <out.pnci>" << std::endl;
+		return 1;
+	}
+	std::string in_file = argv[1];
+	std::string out_file = argv[2];
+
+	try {
+		MeshFile meshes(in_file);
+		if (meshes.indexed) {
+			throw std::runtime_error("'" + in_file + "' is already indexed.");
+		}
+
+		size_t in_vertices = meshes.vertices.size();
+		meshes.make_indexed();
+		meshes.save(out_file);
+
+		bool short_indices = meshes.short_indices();
+		size_t in_bytes = in_vertices * sizeof(MeshFile::Vertex);
+		size_t out_bytes = meshes.vertices.size() * sizeof(MeshFile::Vertex) + meshes.indices.size() * (short_indices ? 2 : 4);
+		std::cout << "Indexed " << meshes.meshes.size() << " meshes from '" << in_file << "' into '" << out_file << "':\n"
+			<< "  " << in_vertices << " vertices (" << in_bytes << " bytes) -> "
+			<< meshes.vertices.size() << " vertices + " << meshes.indices.size() << " " << (short_indices ? 16 : 32) << "-bit indices (" << out_bytes << " bytes)." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
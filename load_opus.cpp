@@ -8,7 +8,7 @@
 #include <stdexcept>
 #include <iostream>
 
-void load_opus(std::string const &filename, std::vector< float > *data_) {
+void load_opus(std::string const &filename, std::vector< float > *data_, uint32_t *channels_) {
 	assert(data_);
 	auto &data = *data_;
 	data.clear();
@@ -25,14 +25,18 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
 	}
 
+	//keep stereo if caller wants it and file has it (op_read_float_stereo downmixes anything wider):
+	uint32_t channels = (channels_ && op_channel_count(op.get(), -1) >= 2 ? 2 : 1);
+	if (channels_) *channels_ = channels;
+
 	//get length in samples:
 	ogg_int64_t length = op_pcm_total(op.get(), -1);
 	if (length >= 0) {
-		data.reserve(length);
+		data.reserve(length * channels);
 	} else {
 		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
 		length = 0;
-		data.reserve(2*48000);
+		data.reserve(2*48000 * channels);
 	}
 
 	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
@@ -40,9 +44,13 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
 		if (ret >= 0) {
 			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
+			if (channels == 2) {
+				data.insert(data.end(), pcm.begin(), pcm.begin() + 2*ret); //already interleaved stereo
+			} else {
+				data.reserve(data.size() + ret);
+				for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+					data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
+				}
 			}
 			if (ret == 0) break;
 		} else {
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 #include <vector>
 
-//Load a WAV file as 48kHz floating-point mono; throws on error:
-void load_wav(std::string const &filename, std::vector< float > *data);
+//Load a WAV file as 48kHz floating-point audio; throws on error:
+// if channels is null, converts to mono;
+// otherwise, keeps stereo (interleaved LRLR...) for stereo/multi-channel files and sets *channels to 1 or 2.
+void load_wav(std::string const &filename, std::vector< float > *data, uint32_t *channels = nullptr);
@@ -0,0 +1,387 @@
+/*
+ * optimize-meshes reorders the triangles of every mesh in a '.pnct' or '.pnci'
+ *  file for the GPU's post-transform vertex cache and for reduced overdraw,
+ *  and writes the result back in the same format.
+ *
+ * Triangles are first ordered for vertex reuse (Tom Forsyth's "Linear-Speed
+ *  Vertex Cache Optimisation"), then that order is split into clusters at
+ *  points where the cache starts over, and clusters are sorted so that
+ *  outward-facing clusters are drawn first (after Sander, Nehab, and Barczak,
+ *  "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+ *  Indexed meshes also have their vertices renumbered in order of first use.
+ *
+ * ACMR (average cache misses per triangle, for a 16-entry FIFO cache) is
+ *  reported before and after. '.pnct' meshes are drawn without indices, so for
+ *  them the ACMR is for the mesh as it would be after index-meshes.
+ *
+ * Usage:
+ *  optimize-meshes <in.pnct|in.pnci> <out.pnct|out.pnci>
+ */
+
+#include "MeshFile.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <cmath>
+
+namespace {
+	//cache misses per triangle for a FIFO cache of the given size:
+	uint32_t count_cache_misses(uint32_t const *indices, uint32_t triangle_count, uint32_t vertex_count, uint32_t cache_size = 16) {
+		std::vector< uint32_t > stamp(vertex_count, 0); //0 == never loaded
+		uint32_t time = cache_size + 1;
+		uint32_t misses = 0;
+		for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+			uint32_t v = indices[i];
+			if (stamp[v] == 0 || time - stamp[v] > cache_size) {
+				stamp[v] = time;
+				time += 1;
+				misses += 1;
+			}
+		}
+		return misses;
+	}
+
+	//Forsyth-style vertex cache ordering; returns triangles in their new order:
+	std::vector< uint32_t > vertex_cache_order(uint32_t const *indices, uint32_t triangle_count, uint32_t vertex_count) {
+		constexpr uint32_t CacheSize = 32;
+		constexpr float CacheDecayPower = 1.5f;
+		constexpr float LastTriScore = 0.75f;
+		constexpr float ValenceBoostScale = 2.0f;
+		constexpr float ValenceBoostPower = 0.5f;
+
+		auto vertex_score = [&](int32_t cache_position, uint32_t remaining) {
+			if (remaining == 0) return -1.0f; //no triangles left to use this vertex
+			float score = 0.0f;
+			if (cache_position >= 0) {
+				if (cache_position < 3) {
+					//vertices of the last triangle get a fixed score, so the next triangle doesn't just reuse its edge:
+					score = LastTriScore;
+				} else {
+					float scaler = 1.0f / (CacheSize - 3);
+					score = std::pow(1.0f - (cache_position - 3) * scaler, CacheDecayPower);
+				}
+			}
+			//boost vertices with few triangles left, so lone triangles aren't left behind:
+			score += ValenceBoostScale * std::pow(float(remaining), -ValenceBoostPower);
+			return score;
+		};
+
+		//triangles using each vertex (the first 'remaining' entries are the ones not yet added):
+		std::vector< uint32_t > remaining(vertex_count, 0);
+		for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+			remaining[indices[i]] += 1;
+		}
+		std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+		for (uint32_t v = 0; v < vertex_count; ++v) {
+			adjacency_begin[v + 1] = adjacency_begin[v] + remaining[v];
+		}
+		std::vector< uint32_t > adjacency(triangle_count * 3);
+		{
+			std::vector< uint32_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+			for (uint32_t i = 0; i < triangle_count * 3; ++i) {
+				adjacency[fill[indices[i]]++] = i / 3;
+			}
+		}
+
+		std::vector< int32_t > cache_position(vertex_count, -1);
+		std::vector< float > score(vertex_count);
+		for (uint32_t v = 0; v < vertex_count; ++v) {
+			score[v] = vertex_score(-1, remaining[v]);
+		}
+		std::vector< float > triangle_score(triangle_count);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			triangle_score[t] = score[indices[3*t+0]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+		}
+		std::vector< bool > added(triangle_count, false);
+
+		std::vector< uint32_t > order;
+		order.reserve(triangle_count);
+
+		std::vector< uint32_t > cache, next_cache;
+		cache.reserve(CacheSize + 3);
+		next_cache.reserve(CacheSize + 3);
+
+		uint32_t cursor = 0; //(first triangle that might not be added yet; used when the cache has nothing to offer)
+		int64_t best = -1;
+		while (order.size() < triangle_count) {
+			if (best < 0) {
+				while (added[cursor]) ++cursor;
+				best = cursor;
+			}
+			uint32_t const *tri = indices + 3 * best;
+
+			added[best] = true;
+			order.emplace_back(uint32_t(best));
+
+			//remove triangle from its vertices' lists of remaining triangles:
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = tri[c];
+				uint32_t *list = adjacency.data() + adjacency_begin[v];
+				for (uint32_t i = 0; i < remaining[v]; ++i) {
+					if (list[i] == uint32_t(best)) {
+						std::swap(list[i], list[remaining[v] - 1]);
+						break;
+					}
+				}
+				remaining[v] -= 1;
+			}
+
+			//triangle's vertices move to the front of the (LRU) cache:
+			next_cache.clear();
+			for (uint32_t c = 0; c < 3; ++c) {
+				if (std::find(next_cache.begin(), next_cache.end(), tri[c]) == next_cache.end()) {
+					next_cache.emplace_back(tri[c]);
+				}
+			}
+			for (uint32_t v : cache) {
+				if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) {
+					next_cache.emplace_back(v);
+				}
+			}
+			std::swap(cache, next_cache);
+
+			//update scores of everything that was or is in the cache:
+			for (uint32_t i = 0; i < cache.size(); ++i) {
+				cache_position[cache[i]] = (i < CacheSize ? int32_t(i) : -1);
+			}
+			for (uint32_t v : cache) {
+				score[v] = vertex_score(cache_position[v], remaining[v]);
+			}
+			if (cache.size() > CacheSize) cache.resize(CacheSize);
+
+			//re-score the triangles touching the cache, and pick the best:
+			best = -1;
+			float best_score = -1.0f;
+			for (uint32_t v : cache) {
+				uint32_t const *list = adjacency.data() + adjacency_begin[v];
+				for (uint32_t i = 0; i < remaining[v]; ++i) {
+					uint32_t t = list[i];
+					triangle_score[t] = score[indices[3*t+0]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+					if (triangle_score[t] > best_score) {
+						best_score = triangle_score[t];
+						best = t;
+					}
+				}
+			}
+		}
+
+		return order;
+	}
+
+	//split a vertex-cache-ordered triangle list into clusters and sort them so outward-facing ones are drawn first:
+	std::vector< uint32_t > overdraw_order(uint32_t const *indices, MeshFile::Vertex const *vertices, std::vector< uint32_t > const &order, uint32_t vertex_count) {
+		constexpr uint32_t CacheSize = 16;
+		constexpr uint32_t MinClusterSize = 16; //(triangles)
+
+		//cluster boundaries are where a triangle's vertices all miss the cache -- the cache "starts over":
+		std::vector< uint32_t > cluster_begin;
+		{
+			std::vector< uint32_t > stamp(vertex_count, 0);
+			uint32_t time = CacheSize + 1;
+			for (uint32_t i = 0; i < order.size(); ++i) {
+				uint32_t misses = 0;
+				for (uint32_t c = 0; c < 3; ++c) {
+					uint32_t v = indices[3 * order[i] + c];
+					if (stamp[v] == 0 || time - stamp[v] > CacheSize) {
+						stamp[v] = time;
+						time += 1;
+						misses += 1;
+					}
+				}
+				if (i == 0 || (misses == 3 && i - cluster_begin.back() >= MinClusterSize)) {
+					cluster_begin.emplace_back(i);
+				}
+			}
+		}
+		if (cluster_begin.size() <= 1) return order;
+		cluster_begin.emplace_back(uint32_t(order.size()));
+
+		auto triangle_area_normal = [&](uint32_t t, glm::vec3 *centroid) {
+			glm::vec3 const &a = vertices[indices[3*t+0]].Position;
+			glm::vec3 const &b = vertices[indices[3*t+1]].Position;
+			glm::vec3 const &c = vertices[indices[3*t+2]].Position;
+			*centroid = (a + b + c) / 3.0f;
+			return glm::cross(b - a, c - a); //(length is twice the area)
+		};
+
+		glm::vec3 mesh_centroid = glm::vec3(0.0f);
+		float mesh_area = 0.0f;
+		for (uint32_t t : order) {
+			glm::vec3 centroid;
+			float area = glm::length(triangle_area_normal(t, &centroid));
+			mesh_centroid += area * centroid;
+			mesh_area += area;
+		}
+		if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+		//sort key: how far out a cluster is, in the direction it faces:
+		uint32_t cluster_count = uint32_t(cluster_begin.size()) - 1;
+		std::vector< float > key(cluster_count);
+		for (uint32_t c = 0; c < cluster_count; ++c) {
+			glm::vec3 normal = glm::vec3(0.0f);
+			glm::vec3 centroid = glm::vec3(0.0f);
+			float area = 0.0f;
+			for (uint32_t i = cluster_begin[c]; i < cluster_begin[c+1]; ++i) {
+				glm::vec3 tri_centroid;
+				glm::vec3 tri_normal = triangle_area_normal(order[i], &tri_centroid);
+				float tri_area = glm::length(tri_normal);
+				normal += tri_normal;
+				centroid += tri_area * tri_centroid;
+				area += tri_area;
+			}
+			if (area > 0.0f) centroid /= area;
+			float length = glm::length(normal);
+			key[c] = (length > 0.0f ? glm::dot(centroid - mesh_centroid, normal / length) : 0.0f);
+		}
+
+		std::vector< uint32_t > clusters(cluster_count);
+		std::iota(clusters.begin(), clusters.end(), 0);
+		std::stable_sort(clusters.begin(), clusters.end(), [&key](uint32_t a, uint32_t b) {
+			return key[a] > key[b];
+		});
+
+		std::vector< uint32_t > sorted;
+		sorted.reserve(order.size());
+		for (uint32_t c : clusters) {
+			sorted.insert(sorted.end(), order.begin() + cluster_begin[c], order.begin() + cluster_begin[c+1]);
+		}
+		return sorted;
+	}
+
+	//ranges that don't overlap any *other* range (so they can be reordered in place):
+	std::vector< bool > exclusive_ranges(std::vector< std::pair< uint32_t, uint32_t > > const &ranges) {
+		std::vector< bool > exclusive(ranges.size(), true);
+		for (uint32_t a = 0; a < ranges.size(); ++a) {
+			for (uint32_t b = 0; b < ranges.size(); ++b) {
+				if (a == b || ranges[a] == ranges[b]) continue;
+				if (ranges[a].first < ranges[b].second && ranges[b].first < ranges[a].second) exclusive[a] = false;
+			}
+		}
+		return exclusive;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct|in.pnci> <out.pnct|out.pnci>" << std::endl;
+		return 1;
+	}
+	std::string in_file = argv[1];
+	std::string out_file = argv[2];
+	if (in_file.size() < 5 || out_file.size() < 5 || in_file.substr(in_file.size() - 5) != out_file.substr(out_file.size() - 5)) {
+		std::cerr << "ERROR: input and output files should have the same extension." << std::endl;
+		return 1;
+	}
+
+	try {
+		MeshFile file(in_file);
+
+		//work on an indexed copy (for '.pnct' files, triangle t of each indexed mesh is triangle t of the original):
+		MeshFile indexed = file;
+		indexed.make_indexed();
+
+		//each distinct (vertex range, index range) is optimized once:
+		std::map< std::pair< uint32_t, uint32_t >, uint32_t > seen;
+		std::vector< uint32_t > work; //(mesh indices)
+		for (uint32_t m = 0; m < indexed.meshes.size(); ++m) {
+			auto const &mesh = indexed.meshes[m];
+			if (seen.emplace(std::make_pair(mesh.index_begin, mesh.index_end), m).second) work.emplace_back(m);
+		}
+
+		//meshes can only be reordered in place if they don't overlap other meshes in the original file:
+		std::vector< std::pair< uint32_t, uint32_t > > vertex_ranges, index_ranges;
+		for (uint32_t m : work) {
+			vertex_ranges.emplace_back(file.meshes[m].vertex_begin, file.meshes[m].vertex_end);
+			index_ranges.emplace_back(file.meshes[m].index_begin, file.meshes[m].index_end);
+		}
+		std::vector< bool > vertex_exclusive = exclusive_ranges(vertex_ranges);
+		std::vector< bool > index_exclusive = exclusive_ranges(index_ranges);
+
+		//...and indexed meshes can only have their vertices renumbered if no other index range uses them:
+		std::map< std::pair< uint32_t, uint32_t >, uint32_t > vertex_range_users;
+		for (auto const &range : vertex_ranges) vertex_range_users[range] += 1;
+
+		uint64_t triangles = 0;
+		uint64_t misses_before = 0;
+		uint64_t misses_after = 0;
+
+		for (uint32_t w = 0; w < work.size(); ++w) {
+			MeshFile::Mesh const &mesh = indexed.meshes[work[w]];
+			MeshFile::Mesh &original = file.meshes[work[w]];
+			uint32_t vertex_count = mesh.vertex_end - mesh.vertex_begin;
+			uint32_t index_count = mesh.index_end - mesh.index_begin;
+			uint32_t const *indices = indexed.indices.data() + mesh.index_begin;
+			MeshFile::Vertex const *vertices = indexed.vertices.data() + mesh.vertex_begin;
+
+			if (index_count % 3 != 0) {
+				std::cerr << "WARNING: skipping mesh '" << mesh.name << "', which isn't made of triangles." << std::endl;
+				continue;
+			}
+			if (!(file.indexed ? index_exclusive[w] : vertex_exclusive[w])) {
+				std::cerr << "WARNING: skipping mesh '" << mesh.name << "', which overlaps another mesh." << std::endl;
+				continue;
+			}
+			uint32_t triangle_count = index_count / 3;
+
+			std::vector< uint32_t > order = vertex_cache_order(indices, triangle_count, vertex_count);
+			order = overdraw_order(indices, vertices, order, vertex_count);
+
+			std::vector< uint32_t > reordered(index_count);
+			for (uint32_t t = 0; t < triangle_count; ++t) {
+				for (uint32_t c = 0; c < 3; ++c) {
+					reordered[3*t+c] = indices[3*order[t]+c];
+				}
+			}
+
+			triangles += triangle_count;
+			misses_before += count_cache_misses(indices, triangle_count, vertex_count);
+			misses_after += count_cache_misses(reordered.data(), triangle_count, vertex_count);
+
+			if (file.indexed) {
+				//renumber vertices in order of first use (if no other mesh uses them):
+				if (vertex_range_users[vertex_ranges[w]] == 1 && vertex_exclusive[w]) {
+					std::vector< uint32_t > remap(vertex_count, -1U);
+					std::vector< MeshFile::Vertex > renumbered;
+					renumbered.reserve(vertex_count);
+					for (uint32_t &i : reordered) {
+						if (remap[i] == -1U) {
+							remap[i] = uint32_t(renumbered.size());
+							renumbered.emplace_back(vertices[i]);
+						}
+						i = remap[i];
+					}
+					for (uint32_t v = 0; v < vertex_count; ++v) {
+						if (remap[v] == -1U) renumbered.emplace_back(vertices[v]); //(unused vertices go at the end)
+					}
+					std::copy(renumbered.begin(), renumbered.end(), file.vertices.begin() + original.vertex_begin);
+				}
+				std::copy(reordered.begin(), reordered.end(), file.indices.begin() + original.index_begin);
+			} else {
+				//move whole triangles of the original triangle soup:
+				std::vector< MeshFile::Vertex > soup(file.vertices.begin() + original.vertex_begin, file.vertices.begin() + original.vertex_end);
+				for (uint32_t t = 0; t < triangle_count; ++t) {
+					for (uint32_t c = 0; c < 3; ++c) {
+						file.vertices[original.vertex_begin + 3*t+c] = soup[3*order[t]+c];
+					}
+				}
+			}
+		}
+
+		file.save(out_file);
+
+		std::cout << "Optimized " << work.size() << " meshes (" << triangles << " triangles) from '" << in_file << "' into '" << out_file << "':\n"
+			<< "  ACMR " << (triangles ? float(misses_before) / triangles : 0.0f)
+			<< " -> " << (triangles ? float(misses_after) / triangles : 0.0f)
+			<< (file.indexed ? "" : " (as indexed)") << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
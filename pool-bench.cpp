@@ -0,0 +1,146 @@
+/*
+ * pool-bench times adding, erasing, and iterating over many objects stored
+ *  in a Pool (see Pool.hpp) versus in a std::list (how Scene used to store
+ *  its transforms, drawables, cameras, and lights).
+ *
+ * Each round:
+ *  - adds N objects
+ *  - iterates over them
+ *  - erases every other one (in shuffled order)
+ *  - adds N/2 objects (which the pool puts in the freed slots)
+ *  - iterates over them again
+ *  - erases all of them
+ *
+ * Usage:
+ *  pool-bench [N (default 100000)] [rounds (default 10)]
+ */
+
+#include "Pool.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <list>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+//(about the size of a Scene::Transform)
+struct Object {
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+	Object *parent = nullptr;
+	glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+	explicit Object(float x) : position(x, 0.0f, 0.0f) { }
+};
+
+//per-operation time (in milliseconds, summed over rounds):
+struct Times {
+	double add = 0.0;
+	double iterate = 0.0;
+	double erase = 0.0;
+	float checksum = 0.0f; //(so the iteration isn't optimized away)
+};
+
+//the container-specific parts:
+// add() returns a key that erase() takes -- a handle for the pool, an iterator for the list
+struct PoolOps {
+	Pool< Object > objects;
+	typedef Pool< Object >::Handle Key;
+	Key add(float x) { return objects.handle(objects.emplace(x)); }
+	void erase(Key const &key) { objects.erase(key); }
+};
+
+struct ListOps {
+	std::list< Object > objects;
+	typedef std::list< Object >::iterator Key;
+	Key add(float x) { objects.emplace_back(x); return std::prev(objects.end()); }
+	void erase(Key const &key) { objects.erase(key); }
+};
+
+template< typename Ops >
+Times run(uint32_t count, uint32_t rounds) {
+	typedef std::chrono::high_resolution_clock Clock;
+	auto ms = [](Clock::time_point a, Clock::time_point b) {
+		return std::chrono::duration< double, std::milli >(b - a).count();
+	};
+
+	Times times;
+	std::mt19937 mt(0xfeedf00d);
+	Ops ops;
+
+	auto add = [&](std::vector< typename Ops::Key > *keys, uint32_t n) {
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < n; ++i) keys->emplace_back(ops.add(float(i)));
+		times.add += ms(before, Clock::now());
+	};
+	auto iterate = [&]() {
+		auto before = Clock::now();
+		float sum = 0.0f;
+		for (auto const &o : ops.objects) sum += o.position.x;
+		times.iterate += ms(before, Clock::now());
+		times.checksum += sum;
+	};
+	auto erase = [&](std::vector< typename Ops::Key > const &keys) {
+		auto before = Clock::now();
+		for (auto const &key : keys) ops.erase(key);
+		times.erase += ms(before, Clock::now());
+	};
+
+	for (uint32_t round = 0; round < rounds; ++round) {
+		std::vector< typename Ops::Key > keys;
+		keys.reserve(count);
+		add(&keys, count);
+		iterate();
+
+		//erase every other object, in shuffled order:
+		std::vector< typename Ops::Key > evens, odds;
+		for (uint32_t i = 0; i < count; ++i) {
+			(i % 2 == 0 ? evens : odds).emplace_back(keys[i]);
+		}
+		std::shuffle(evens.begin(), evens.end(), mt);
+		erase(evens);
+
+		add(&odds, uint32_t(evens.size()));
+		iterate();
+
+		erase(odds);
+		if (!ops.objects.empty()) throw std::runtime_error("Objects left over after erasing everything.");
+	}
+	return times;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [N] [rounds]" << std::endl;
+		return 1;
+	}
+
+	try {
+		uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 100000);
+		uint32_t rounds = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 10);
+
+		std::cout << "Adding, erasing, and iterating over " << count << " objects (" << sizeof(Object) << " bytes each), " << rounds << " rounds:" << std::endl;
+
+		auto report = [](std::string const &name, Times const &times) {
+			std::cout << "  " << std::setw(10) << std::left << name << std::right << std::fixed << std::setprecision(2)
+				<< " add " << std::setw(9) << times.add << "ms"
+				<< "  iterate " << std::setw(9) << times.iterate << "ms"
+				<< "  erase " << std::setw(9) << times.erase << "ms"
+				<< "  (checksum " << times.checksum << ")" << std::endl;
+		};
+		report("Pool", run< PoolOps >(count, rounds));
+		report("std::list", run< ListOps >(count, rounds));
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
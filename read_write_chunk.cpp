@@ -0,0 +1,308 @@
+#include "read_write_chunk.hpp"
+#include "Jobs.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+
+size_t parse_chunk_header(char const *data, size_t available, std::string const &magic, ChunkInfo *info) {
+	assert(info);
+
+	ChunkHeader header;
+	if (available < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (chunk_magic(header.magic) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (uint8_t(header.magic[0]) & ChunkExtendedMark) {
+		ChunkExtendedHeader extended;
+		if (available < sizeof(extended)) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		std::memcpy(&extended, data, sizeof(extended));
+		if (extended.flags & ~ChunkFlagCompressed) {
+			throw std::runtime_error("Unsupported chunk header flags " + std::to_string(extended.flags) + ".");
+		}
+		info->compressed = (extended.flags & ChunkFlagCompressed) != 0;
+		info->stored = extended.size;
+		return sizeof(extended);
+	} else {
+		info->compressed = false;
+		info->stored = header.size;
+		return sizeof(header);
+	}
+}
+
+ChunkInfo read_chunk_header(std::istream &from, std::string const &magic) {
+	char data[sizeof(ChunkExtendedHeader)];
+	if (!from.read(data, sizeof(ChunkHeader))) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	size_t available = sizeof(ChunkHeader);
+
+	//extended headers are longer:
+	if (uint8_t(data[0]) & ChunkExtendedMark) {
+		if (!from.read(data + sizeof(ChunkHeader), sizeof(ChunkExtendedHeader) - sizeof(ChunkHeader))) {
+			throw std::runtime_error("Failed to read chunk header");
+		}
+		available = sizeof(ChunkExtendedHeader);
+	}
+
+	ChunkInfo info;
+	parse_chunk_header(data, available, magic, &info);
+	return info;
+}
+
+void write_chunk_header(std::string const &magic, ChunkInfo const &info, std::ostream *to_) {
+	assert(magic.size() == 4);
+	assert(!(uint8_t(magic[0]) & ChunkExtendedMark) && "magic numbers are ASCII");
+	assert(to_);
+	auto &to = *to_;
+
+	if (!info.compressed && info.stored <= ChunkShortSizeLimit) {
+		ChunkHeader header;
+		header.magic[0] = magic[0];
+		header.magic[1] = magic[1];
+		header.magic[2] = magic[2];
+		header.magic[3] = magic[3];
+		header.size = uint32_t(info.stored);
+		to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	} else {
+		ChunkExtendedHeader header;
+		header.magic[0] = char(uint8_t(magic[0]) | ChunkExtendedMark);
+		header.magic[1] = magic[1];
+		header.magic[2] = magic[2];
+		header.magic[3] = magic[3];
+		header.flags = (info.compressed ? ChunkFlagCompressed : 0);
+		header.size = info.stored;
+		to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	}
+}
+
+void ChunkDirectoryWriter::write(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	//directory is written first, so chunks start right after it:
+	std::vector< ChunkDirectoryEntry > directory;
+	directory.reserve(chunks.size());
+	uint64_t offset = sizeof(ChunkHeader) + chunks.size() * sizeof(ChunkDirectoryEntry);
+	for (auto const &chunk : chunks) {
+		assert(chunk.first.size() == 4);
+		directory.emplace_back();
+		ChunkDirectoryEntry &entry = directory.back();
+		entry.magic[0] = chunk.first[0];
+		entry.magic[1] = chunk.first[1];
+		entry.magic[2] = chunk.first[2];
+		entry.magic[3] = chunk.first[3];
+		entry.offset = offset;
+		entry.size = chunk.second.size();
+		offset += chunk.second.size();
+	}
+	//(directory itself is always small enough for a plain header)
+	assert(directory.size() * sizeof(ChunkDirectoryEntry) <= ChunkShortSizeLimit);
+
+	write_chunk("dir0", directory, &to);
+	for (auto const &chunk : chunks) {
+		to.write(chunk.second.data(), chunk.second.size());
+	}
+}
+
+//-------------------------
+
+namespace {
+	//decode (and sanity-check) the fixed-size start of a compressed chunk; returns the block count:
+	uint32_t decode_block_table_head(char const *data, ChunkBlockTableHead *head) {
+		std::memcpy(head, data, sizeof(ChunkBlockTableHead));
+		if (head->reserved != 0) {
+			throw std::runtime_error("Compressed chunk has unknown table options.");
+		}
+		if (head->bytes == 0) return 0;
+		if (head->block_size == 0) {
+			throw std::runtime_error("Compressed chunk has zero block size.");
+		}
+		uint64_t blocks = (head->bytes + head->block_size - 1) / head->block_size;
+		if (blocks > 0xffffffff) {
+			throw std::runtime_error("Compressed chunk has too many blocks.");
+		}
+		return uint32_t(blocks);
+	}
+
+	//inflate one block; throws if it doesn't inflate to exactly 'length' bytes:
+	void inflate_block(char const *packed, size_t packed_length, char *out, size_t length) {
+		uLongf got = uLongf(length);
+		int ret = uncompress(reinterpret_cast< Bytef * >(out), &got, reinterpret_cast< Bytef const * >(packed), uLong(packed_length));
+		if (ret != Z_OK || got != length) {
+			throw std::runtime_error("zlib error " + std::to_string(ret) + " decompressing chunk block.");
+		}
+	}
+}
+
+void compress_chunk_data(char const *data, size_t bytes, uint32_t block_size, std::vector< char > *compressed_) {
+	assert(compressed_);
+	auto &compressed = *compressed_;
+	assert(block_size > 0);
+
+	uint64_t blocks = (uint64_t(bytes) + block_size - 1) / block_size;
+	if (blocks > 0xffffffff) {
+		throw std::runtime_error("Chunk is too large to compress with this block size.");
+	}
+
+	//compress each block separately (in parallel):
+	std::vector< std::vector< Bytef > > packed(static_cast< size_t >(blocks));
+	Jobs::parallel_for(uint32_t(blocks), [&](uint32_t b) {
+		size_t begin = size_t(b) * block_size;
+		uLong length = uLong(std::min< size_t >(block_size, bytes - begin));
+		uLongf packed_length = compressBound(length);
+		packed[b].resize(packed_length);
+		int ret = compress2(packed[b].data(), &packed_length, reinterpret_cast< Bytef const * >(data + begin), length, Z_BEST_COMPRESSION);
+		if (ret != Z_OK) {
+			throw std::runtime_error("zlib error " + std::to_string(ret) + " compressing chunk.");
+		}
+		packed[b].resize(packed_length);
+	});
+
+	//table (uncompressed size, block size, block sizes), then blocks:
+	compressed.resize(sizeof(ChunkBlockTableHead) + packed.size() * sizeof(uint32_t));
+	ChunkBlockTableHead head;
+	head.bytes = bytes;
+	head.block_size = block_size;
+	std::memcpy(&compressed[0], &head, sizeof(head));
+	for (size_t b = 0; b < packed.size(); ++b) {
+		uint32_t packed_length = uint32_t(packed[b].size());
+		std::memcpy(&compressed[sizeof(ChunkBlockTableHead) + b * sizeof(uint32_t)], &packed_length, sizeof(uint32_t));
+	}
+	for (auto const &p : packed) {
+		compressed.insert(compressed.end(), p.begin(), p.end());
+	}
+}
+
+uint64_t uncompressed_chunk_size(char const *compressed, size_t compressed_bytes) {
+	if (compressed_bytes < sizeof(ChunkBlockTableHead)) {
+		throw std::runtime_error("Compressed chunk is too small to contain a header.");
+	}
+	ChunkBlockTableHead head;
+	decode_block_table_head(compressed, &head);
+	return head.bytes;
+}
+
+void decompress_chunk_data(char const *compressed, size_t compressed_bytes, char *out) {
+	if (compressed_bytes < sizeof(ChunkBlockTableHead)) {
+		throw std::runtime_error("Compressed chunk is too small to contain a header.");
+	}
+	ChunkBlockTableHead head;
+	uint32_t blocks = decode_block_table_head(compressed, &head);
+
+	size_t table = sizeof(ChunkBlockTableHead) + size_t(blocks) * sizeof(uint32_t);
+	if (compressed_bytes < table) {
+		throw std::runtime_error("Compressed chunk is too small to contain its block table.");
+	}
+
+	//figure out where each block starts:
+	std::vector< size_t > offsets(size_t(blocks) + 1);
+	offsets[0] = table;
+	for (uint32_t b = 0; b < blocks; ++b) {
+		uint32_t packed_length;
+		std::memcpy(&packed_length, compressed + sizeof(ChunkBlockTableHead) + b * sizeof(uint32_t), sizeof(packed_length));
+		offsets[b+1] = offsets[b] + packed_length;
+	}
+	if (offsets.back() != compressed_bytes) {
+		throw std::runtime_error("Compressed chunk block sizes don't match chunk size.");
+	}
+
+	//inflate blocks (in parallel):
+	Jobs::parallel_for(blocks, [&](uint32_t b) {
+		uint64_t begin = uint64_t(b) * head.block_size;
+		size_t length = size_t(std::min< uint64_t >(head.block_size, head.bytes - begin));
+		inflate_block(compressed + offsets[b], offsets[b+1] - offsets[b], out + begin, length);
+	});
+}
+
+//-------------------------
+
+void read_chunk_pieces(
+	ChunkInfo const &info,
+	std::function< void(char *, size_t) > const &read_stored,
+	size_t element_size,
+	size_t max_piece_bytes,
+	std::function< void(char const *, size_t) > const &on_piece
+) {
+	assert(element_size > 0);
+	size_t piece_bytes = max_piece_bytes - max_piece_bytes % element_size;
+	if (piece_bytes == 0) {
+		throw std::runtime_error("Chunk piece size is smaller than one element.");
+	}
+
+	if (!info.compressed) {
+		if (info.stored % element_size != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		//plain chunks can be read straight into the piece buffer:
+		std::vector< char > piece(size_t(std::min< uint64_t >(piece_bytes, info.stored)));
+		for (uint64_t remaining = info.stored; remaining > 0; /* later */) {
+			size_t length = size_t(std::min< uint64_t >(piece.size(), remaining));
+			read_stored(piece.data(), length);
+			on_piece(piece.data(), length);
+			remaining -= length;
+		}
+		return;
+	}
+
+	//compressed chunks are inflated one block at a time and re-cut into pieces:
+	if (info.stored < sizeof(ChunkBlockTableHead)) {
+		throw std::runtime_error("Compressed chunk is too small to contain a header.");
+	}
+	char head_data[sizeof(ChunkBlockTableHead)];
+	read_stored(head_data, sizeof(head_data));
+	ChunkBlockTableHead head;
+	uint32_t blocks = decode_block_table_head(head_data, &head);
+	if (head.bytes % element_size != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	if (info.stored - sizeof(ChunkBlockTableHead) < uint64_t(blocks) * sizeof(uint32_t)) {
+		throw std::runtime_error("Compressed chunk is too small to contain its block table.");
+	}
+	std::vector< uint32_t > packed_lengths(blocks);
+	read_stored(reinterpret_cast< char * >(packed_lengths.data()), packed_lengths.size() * sizeof(uint32_t));
+
+	uint64_t total = sizeof(ChunkBlockTableHead) + uint64_t(blocks) * sizeof(uint32_t);
+	for (auto l : packed_lengths) total += l;
+	if (total != info.stored) {
+		throw std::runtime_error("Compressed chunk block sizes don't match chunk size.");
+	}
+
+	std::vector< char > piece(size_t(std::min< uint64_t >(piece_bytes, head.bytes)));
+	size_t filled = 0;
+
+	std::vector< char > packed;
+	std::vector< char > block(size_t(std::min< uint64_t >(head.block_size, head.bytes)));
+	for (uint32_t b = 0; b < blocks; ++b) {
+		packed.resize(packed_lengths[b]);
+		read_stored(packed.data(), packed.size());
+
+		uint64_t begin = uint64_t(b) * head.block_size;
+		size_t length = size_t(std::min< uint64_t >(head.block_size, head.bytes - begin));
+		inflate_block(packed.data(), packed.size(), block.data(), length);
+
+		//copy block into pieces, handing off each piece as it fills:
+		for (size_t at = 0; at < length; /* later */) {
+			size_t count = std::min(length - at, piece.size() - filled);
+			std::memcpy(piece.data() + filled, block.data() + at, count);
+			filled += count;
+			at += count;
+			if (filled == piece.size()) {
+				on_piece(piece.data(), filled);
+				filled = 0;
+			}
+		}
+	}
+	//(chunk size is a multiple of element size, so anything left is whole elements)
+	if (filled != 0) {
+		on_piece(piece.data(), filled);
+	}
+}
@@ -1,65 +1,211 @@
 #pragma once
 
 #include <iostream>
+#include <sstream>
 #include <vector>
+#include <string>
+#include <utility>
+#include <functional>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstddef>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
 // |ma|gi|c.|..| <-- four byte "magic number"
 // |sz|sz|sz|sz| <-- four byte (native endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
+//
+//Chunks that are compressed or too big for a four-byte size use an extended header instead:
+// |ma|gi|c.|..| <-- the same magic number, but with the high bit of its first byte set
+// |fl|fl|fl|fl| <-- four byte flags (ChunkFlagCompressed; other bits must be zero)
+// |s8|s8|s8|s8|s8|s8|s8|s8| <-- eight byte (native endian) size
+// (magic numbers are ASCII, so plain headers -- including every file written before extended
+//  headers existed -- never have that bit set, and keep all 32 bits of their size)
+//
+//If ChunkFlagCompressed is set, the size gives the size of the stored data, and that data is:
+//   |us|us|us|us|us|us|us|us| <-- uncompressed size (bytes, eight bytes)
+//   |bs|bs|bs|bs| <-- block size (bytes of uncompressed data per block; last block may be short)
+//   |00|00|00|00| <-- reserved (must be zero)
+//   |c0|c0|c0|c0| ... <-- compressed size of each block (ceil(us/bs) entries)
+//   |zlib stream| ... <-- each block, compressed separately (so blocks can be inflated in parallel)
+
+struct ChunkHeader {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t size = 0;
+};
+static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+struct ChunkExtendedHeader {
+	char magic[4] = {'\0', '\0', '\0', '\0'}; //(magic[0] has ChunkExtendedMark set)
+	uint32_t flags = 0;
+	uint64_t size = 0;
+};
+static_assert(sizeof(ChunkExtendedHeader) == 16, "extended header is packed");
+
+constexpr uint8_t ChunkExtendedMark = 0x80; //set in magic[0] of extended headers
+constexpr uint32_t ChunkFlagCompressed = 0x1;
+
+//largest size that fits in a plain header:
+constexpr uint64_t ChunkShortSizeLimit = 0xffffffff;
+
+//magic number of the chunk whose header starts at 'data' (with any ChunkExtendedMark cleared):
+inline std::string chunk_magic(char const *data) {
+	std::string magic(data, 4);
+	magic[0] = char(uint8_t(magic[0]) & ~ChunkExtendedMark);
+	return magic;
+}
+
+//Files may optionally start with a chunk directory -- a "dir0" chunk listing every chunk that follows,
+// so that readers can seek straight to the chunks they need:
+struct ChunkDirectoryEntry {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t reserved = 0; //(padding, keeps offsets 8-byte aligned)
+	uint64_t offset = 0; //position of chunk's header, from start of file
+	uint64_t size = 0; //size of chunk, including header
+};
+static_assert(sizeof(ChunkDirectoryEntry) == 24, "directory entry is packed");
+
+//the fixed-size start of a compressed chunk's data (as above):
+struct ChunkBlockTableHead {
+	uint64_t bytes = 0; //uncompressed size
+	uint32_t block_size = 0; //uncompressed bytes per block
+	uint32_t reserved = 0; //(must be zero; keeps the head a whole number of 8-byte words)
+};
+static_assert(sizeof(ChunkBlockTableHead) == 16, "block table head is packed");
+
+//default amount of uncompressed data per compressed block:
+constexpr uint32_t ChunkCompressedBlockSize = 256 * 1024;
+
+//Decoded chunk header (helpers defined in read_write_chunk.cpp):
+struct ChunkInfo {
+	uint64_t stored = 0; //bytes of chunk data that follow the header
+	bool compressed = false; //is that data compressed?
+};
+// parse a header from memory; returns the length of the header in bytes (throws on bad header or magic):
+size_t parse_chunk_header(char const *data, size_t available, std::string const &magic, ChunkInfo *info);
+// read a header from a stream (throws on bad header or magic):
+ChunkInfo read_chunk_header(std::istream &from, std::string const &magic);
+// write a header (picks the plain or extended layout as needed):
+void write_chunk_header(std::string const &magic, ChunkInfo const &info, std::ostream *to);
+
+//compressed chunk helpers:
+// compress 'bytes' bytes of 'data' into the compressed chunk layout above:
+void compress_chunk_data(char const *data, size_t bytes, uint32_t block_size, std::vector< char > *compressed);
+// uncompressed size of a compressed chunk (throws if the chunk data is malformed):
+uint64_t uncompressed_chunk_size(char const *compressed, size_t compressed_bytes);
+// inflate a compressed chunk into 'out', which must hold uncompressed_chunk_size() bytes:
+//  (blocks are inflated in parallel using Jobs::parallel_for)
+void decompress_chunk_data(char const *compressed, size_t compressed_bytes, char *out);
+
+//streamed chunk helper (used by read_chunk_pieces and ChunkFile):
+// 'read_stored' is called to fetch the next 'bytes' bytes of the chunk's stored data, in order;
+// 'on_piece' is called with consecutive pieces of the (uncompressed) chunk data, each a whole
+// number of elements and at most max_piece_bytes long.
+// Only one piece (and, for compressed chunks, one block) is held in memory at a time.
+void read_chunk_pieces(
+	ChunkInfo const &info,
+	std::function< void(char *, size_t) > const &read_stored,
+	size_t element_size,
+	size_t max_piece_bytes,
+	std::function< void(char const *, size_t) > const &on_piece
+);
 
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+	ChunkInfo info = read_chunk_header(from, magic);
 
-	ChunkHeader header;
-	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
-		throw std::runtime_error("Failed to read chunk header");
-	}
-	if (std::string(header.magic,4) != magic) {
-		throw std::runtime_error("Unexpected magic number in chunk");
+	if (info.compressed) {
+		std::vector< char > compressed(size_t(info.stored));
+		if (!from.read(compressed.data(), compressed.size())) {
+			throw std::runtime_error("Failed to read chunk data.");
+		}
+		uint64_t bytes = uncompressed_chunk_size(compressed.data(), compressed.size());
+		if (bytes % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		to.resize(size_t(bytes / sizeof(T)));
+		decompress_chunk_data(compressed.data(), compressed.size(), reinterpret_cast< char * >(to.data()));
+		return;
 	}
 
-	if (header.size % sizeof(T) != 0) {
+	if (info.stored % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
 
-	to.resize(header.size / sizeof(T));
+	to.resize(size_t(info.stored / sizeof(T)));
 	if (!from.read(reinterpret_cast< char * >(&to[0]), to.size() * sizeof(T))) {
 		throw std::runtime_error("Failed to read chunk data.");
 	}
 }
 
+//helper function that reads a chunk in the same format as read_chunk, but a piece at a time:
+// on_piece(data, count, first) gets data[0 .. count-1] == chunk elements [first .. first+count-1],
+// with count <= max_piece_count; data is only valid during the call.
+template< typename T >
+void read_chunk_pieces(std::istream &from, std::string const &magic, size_t max_piece_count, std::function< void(T const *, size_t, size_t) > const &on_piece) {
+	assert(max_piece_count > 0);
+
+	ChunkInfo info = read_chunk_header(from, magic);
+
+	size_t first = 0;
+	read_chunk_pieces(info,
+		[&from](char *data, size_t bytes) {
+			if (!from.read(data, bytes)) {
+				throw std::runtime_error("Failed to read chunk data.");
+			}
+		},
+		sizeof(T), max_piece_count * sizeof(T),
+		[&](char const *data, size_t bytes) {
+			on_piece(reinterpret_cast< T const * >(data), bytes / sizeof(T), first);
+			first += bytes / sizeof(T);
+		}
+	);
+}
+
 
 //helper function to write a chunk of data in the same format as read_chunk:
+// (pass compress = true to write a compressed chunk)
 template< typename T >
-void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
+void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_, bool compress = false) {
 	assert(magic.size() == 4);
 	assert(to_);
 	auto &to = *to_;
 
-	struct ChunkHeader {
-		char magic[4] = {'\0', '\0', '\0', '\0'};
-		uint32_t size = 0;
-	};
-	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
-	ChunkHeader header;
-	header.magic[0] = magic[0];
-	header.magic[1] = magic[1];
-	header.magic[2] = magic[2];
-	header.magic[3] = magic[3];
-	header.size = uint32_t(from.size() * sizeof(T));
-
-	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	ChunkInfo info;
+	if (compress) {
+		std::vector< char > compressed;
+		compress_chunk_data(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T), ChunkCompressedBlockSize, &compressed);
+		info.stored = compressed.size();
+		info.compressed = true;
+
+		write_chunk_header(magic, info, &to);
+		to.write(compressed.data(), compressed.size());
+		return;
+	}
+
+	info.stored = uint64_t(from.size()) * sizeof(T);
+
+	write_chunk_header(magic, info, &to);
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+//helper that collects chunks and writes them out preceded by a chunk directory:
+struct ChunkDirectoryWriter {
+	//add a chunk (in the same format as write_chunk):
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &from, bool compress = false) {
+		std::ostringstream chunk;
+		write_chunk(magic, from, &chunk, compress);
+		chunks.emplace_back(magic, chunk.str());
+	}
+
+	//write a "dir0" chunk followed by all added chunks (defined in read_write_chunk.cpp):
+	void write(std::ostream *to) const;
+
+	std::vector< std::pair< std::string, std::string > > chunks; //(magic, serialized chunk)
+};
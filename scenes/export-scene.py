@@ -220,11 +220,24 @@ def write_chunk(magic, data):
 	blob.write(struct.pack('I', len(data))) #length
 	blob.write(data)
 
-write_chunk(b'str0', strings_data)
-write_chunk(b'xfh0', xfh_data)
-write_chunk(b'msh0', mesh_data)
-write_chunk(b'cam0', camera_data)
-write_chunk(b'lmp0', lamp_data)
+chunks = [
+	(b'str0', strings_data),
+	(b'xfh0', xfh_data),
+	(b'msh0', mesh_data),
+	(b'cam0', camera_data),
+	(b'lmp0', lamp_data),
+]
+
+#chunk directory (magic, reserved, offset, size of each chunk) lets readers seek straight to the chunks they need:
+directory = b""
+offset = 8 + 24 * len(chunks)
+for (magic, data) in chunks:
+	directory += struct.pack('4sIQQ', magic, 0, offset, 8 + len(data))
+	offset += 8 + len(data)
+write_chunk(b'dir0', directory)
+
+for (magic, data) in chunks:
+	write_chunk(magic, data)
 
 print("Wrote " + str(blob.tell()) + " bytes to '" + outfile + "'")
 blob.close()
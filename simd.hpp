@@ -0,0 +1,10 @@
+#pragma once
+
+//Defines HAVE_SSE (and includes the SSE intrinsics) when compiling for a target that always has SSE:
+// (any x86-64 target; 32-bit x86 when built with SSE enabled)
+//code using the intrinsics should keep a plain fallback under #else
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define HAVE_SSE
+#endif
@@ -0,0 +1,429 @@
+/*
+ * simplify-meshes adds levels of detail to every mesh in a '.pnct' or '.pnci'
+ *  file: simplified copies of each mesh, with roughly 1/2, 1/4, and 1/8 of its
+ *  triangles, stored as extra meshes named "<name>@lod1", "<name>@lod2", ...
+ *  (MeshBuffer gathers these into Mesh::lods; Scene::draw picks between them.)
+ *
+ * Simplification is by repeated edge collapse, cheapest first, with the cost
+ *  of a collapse measured by quadric error (Garland and Heckbert, "Surface
+ *  Simplification Using Quadric Error Metrics"). Collapses move one vertex
+ *  onto the other, so simplified meshes reuse the original vertices: in
+ *  '.pnci' files, each level is just another index range over its mesh's
+ *  vertices. ('.pnct' levels are written as new triangles.)
+ *
+ * Vertices at the same position are welded before simplifying (so seams in
+ *  normals or texture coordinates don't split the surface), and open
+ *  boundaries get extra weight so they stay put.
+ *
+ * Meshes with fewer than 64 triangles are left alone. Running optimize-meshes
+ *  afterward puts the new triangles in a good order.
+ *
+ * Usage:
+ *  simplify-meshes <in.pnct|in.pnci> <out.pnct|out.pnci>
+ */
+
+#include "MeshFile.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <array>
+#include <queue>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <iterator>
+#include <cmath>
+
+namespace {
+	//symmetric 4x4 error quadric, stored as its upper triangle:
+	// (error(p) is the weighted sum of squared distances from p to the planes that were added)
+	struct Quadric {
+		double q[10] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+		//add the plane dot(n,p) + d = 0 (n unit length), scaled by weight:
+		void add_plane(glm::vec3 const &n, double d, double weight) {
+			double a = n.x, b = n.y, c = n.z;
+			q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+			q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+			q[7] += weight * c * c; q[8] += weight * c * d;
+			q[9] += weight * d * d;
+		}
+
+		Quadric &operator+=(Quadric const &o) {
+			for (uint32_t i = 0; i < 10; ++i) q[i] += o.q[i];
+			return *this;
+		}
+
+		double error(glm::vec3 const &p) const {
+			double x = p.x, y = p.y, z = p.z;
+			return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+			     + q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+			     + q[7] * z * z + 2.0 * q[8] * z
+			     + q[9];
+		}
+	};
+
+	//simplify a mesh down to (at most, if possible) each of the given triangle counts:
+	// targets must be decreasing; returns one list of indices (into the mesh's vertices) per target.
+	std::vector< std::vector< uint32_t > > simplify(uint32_t const *indices, uint32_t triangle_count, MeshFile::Vertex const *vertices, uint32_t vertex_count, std::vector< uint32_t > const &targets) {
+		constexpr double BoundaryWeight = 10.0; //keeps open edges from wandering
+		constexpr float MinNormalDot = 0.25f; //collapses that turn a triangle more than this are rejected
+
+		//weld vertices by position ("points" are welded vertices):
+		std::vector< uint32_t > point_of(vertex_count);
+		std::vector< glm::vec3 > position; //per point
+		std::vector< std::vector< uint32_t > > point_vertices; //vertices at each point
+		{
+			std::map< std::array< float, 3 >, uint32_t > welded;
+			for (uint32_t v = 0; v < vertex_count; ++v) {
+				glm::vec3 const &p = vertices[v].Position;
+				auto ret = welded.emplace(std::array< float, 3 >{{p.x, p.y, p.z}}, uint32_t(position.size()));
+				if (ret.second) {
+					position.emplace_back(p);
+					point_vertices.emplace_back();
+				}
+				point_of[v] = ret.first->second;
+				point_vertices[point_of[v]].emplace_back(v);
+			}
+		}
+		uint32_t point_count = uint32_t(position.size());
+
+		//triangles (as vertex indices) and the triangles around each point:
+		std::vector< uint32_t > tris(indices, indices + 3 * triangle_count);
+		std::vector< bool > tri_alive(triangle_count, true);
+		std::vector< std::vector< uint32_t > > point_tris(point_count);
+		uint32_t alive = 0;
+
+		auto tri_point = [&](uint32_t t, uint32_t c) {
+			return point_of[tris[3*t+c]];
+		};
+
+		//quadrics from the planes of triangles (weighted by area) and boundary edges:
+		std::vector< Quadric > quadric(point_count);
+		std::map< std::pair< uint32_t, uint32_t >, std::pair< uint32_t, uint32_t > > edge_uses; //edge -> (count, a triangle)
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			uint32_t a = tri_point(t, 0), b = tri_point(t, 1), c = tri_point(t, 2);
+			if (a == b || b == c || c == a) {
+				//(degenerate triangles never appear in simplified meshes)
+				tri_alive[t] = false;
+				continue;
+			}
+			alive += 1;
+			for (uint32_t i = 0; i < 3; ++i) {
+				point_tris[tri_point(t, i)].emplace_back(t);
+			}
+
+			glm::vec3 n = glm::cross(position[b] - position[a], position[c] - position[a]);
+			float len = glm::length(n);
+			if (len == 0.0f) continue;
+			n /= len;
+			Quadric plane;
+			plane.add_plane(n, -double(glm::dot(n, position[a])), 0.5 * len);
+			quadric[a] += plane;
+			quadric[b] += plane;
+			quadric[c] += plane;
+
+			for (uint32_t i = 0; i < 3; ++i) {
+				uint32_t p0 = tri_point(t, i), p1 = tri_point(t, (i+1)%3);
+				auto &uses = edge_uses[std::make_pair(std::min(p0, p1), std::max(p0, p1))];
+				uses.first += 1;
+				uses.second = t;
+			}
+		}
+		for (auto const &[edge, uses] : edge_uses) {
+			if (uses.first != 1) continue;
+			uint32_t t = uses.second;
+			glm::vec3 face = glm::cross(position[tri_point(t, 1)] - position[tri_point(t, 0)], position[tri_point(t, 2)] - position[tri_point(t, 0)]);
+			glm::vec3 along = position[edge.second] - position[edge.first];
+			glm::vec3 n = glm::cross(along, face);
+			float len = glm::length(n);
+			if (len == 0.0f) continue;
+			n /= len;
+			Quadric plane;
+			plane.add_plane(n, -double(glm::dot(n, position[edge.first])), BoundaryWeight * double(glm::dot(along, along)));
+			quadric[edge.first] += plane;
+			quadric[edge.second] += plane;
+		}
+
+		//candidate collapses (point 'from' moves onto point 'to'), cheapest first:
+		// (entries go stale when either point changes; stamps catch that)
+		struct Collapse {
+			double cost;
+			uint32_t from, to;
+			uint32_t from_stamp, to_stamp;
+			bool operator>(Collapse const &o) const { return cost > o.cost; }
+		};
+		std::priority_queue< Collapse, std::vector< Collapse >, std::greater< Collapse > > queue;
+		std::vector< uint32_t > stamp(point_count, 0);
+		std::vector< bool > point_alive(point_count, true);
+
+		auto push_collapses = [&](uint32_t p) {
+			for (uint32_t t : point_tris[p]) {
+				if (!tri_alive[t]) continue;
+				for (uint32_t c = 0; c < 3; ++c) {
+					uint32_t o = tri_point(t, c);
+					if (o == p) continue;
+					Quadric sum = quadric[p];
+					sum += quadric[o];
+					queue.push(Collapse{sum.error(position[o]), p, o, stamp[p], stamp[o]});
+					queue.push(Collapse{sum.error(position[p]), o, p, stamp[o], stamp[p]});
+				}
+			}
+		};
+		for (uint32_t p = 0; p < point_count; ++p) {
+			push_collapses(p);
+		}
+
+		//points sharing a live triangle with p:
+		auto neighbors = [&](uint32_t p) {
+			std::vector< uint32_t > ret;
+			for (uint32_t t : point_tris[p]) {
+				if (!tri_alive[t]) continue;
+				for (uint32_t c = 0; c < 3; ++c) {
+					if (tri_point(t, c) != p) ret.emplace_back(tri_point(t, c));
+				}
+			}
+			std::sort(ret.begin(), ret.end());
+			ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+			return ret;
+		};
+
+		auto can_collapse = [&](uint32_t from, uint32_t to) {
+			//the edge must still exist, and (to keep the surface manifold) the only points
+			// next to both ends should be the far corners of the triangles on the edge:
+			uint32_t shared_tris = 0;
+			for (uint32_t t : point_tris[from]) {
+				if (!tri_alive[t]) continue;
+				if (tri_point(t, 0) == to || tri_point(t, 1) == to || tri_point(t, 2) == to) shared_tris += 1;
+			}
+			if (shared_tris == 0) return false;
+			std::vector< uint32_t > from_neighbors = neighbors(from);
+			std::vector< uint32_t > to_neighbors = neighbors(to);
+			std::vector< uint32_t > shared;
+			std::set_intersection(from_neighbors.begin(), from_neighbors.end(), to_neighbors.begin(), to_neighbors.end(), std::back_inserter(shared));
+			if (shared.size() != shared_tris) return false;
+
+			//triangles that move shouldn't flip or collapse:
+			for (uint32_t t : point_tris[from]) {
+				if (!tri_alive[t]) continue;
+				glm::vec3 before[3], after[3];
+				bool has_to = false;
+				for (uint32_t c = 0; c < 3; ++c) {
+					uint32_t p = tri_point(t, c);
+					if (p == to) has_to = true;
+					before[c] = position[p];
+					after[c] = (p == from ? position[to] : position[p]);
+				}
+				if (has_to) continue; //(will be removed)
+				glm::vec3 n_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 n_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+				float len_before = glm::length(n_before);
+				float len_after = glm::length(n_after);
+				if (len_after == 0.0f) return false;
+				if (len_before > 0.0f && glm::dot(n_before, n_after) < MinNormalDot * len_before * len_after) return false;
+			}
+			return true;
+		};
+
+		//vertex at point 'to' that best stands in for vertex v (which is being moved there):
+		auto closest_vertex = [&](uint32_t v, uint32_t to) {
+			MeshFile::Vertex const &a = vertices[v];
+			uint32_t best = point_vertices[to][0];
+			float best_dis = std::numeric_limits< float >::infinity();
+			for (uint32_t w : point_vertices[to]) {
+				MeshFile::Vertex const &b = vertices[w];
+				glm::vec3 color = (glm::vec3(a.Color) - glm::vec3(b.Color)) / 255.0f;
+				float dis = glm::dot(a.Normal - b.Normal, a.Normal - b.Normal)
+				          + glm::dot(a.TexCoord - b.TexCoord, a.TexCoord - b.TexCoord)
+				          + glm::dot(color, color);
+				if (dis < best_dis) {
+					best = w;
+					best_dis = dis;
+				}
+			}
+			return best;
+		};
+
+		auto snapshot = [&]() {
+			std::vector< uint32_t > ret;
+			ret.reserve(3 * alive);
+			for (uint32_t t = 0; t < triangle_count; ++t) {
+				if (!tri_alive[t]) continue;
+				ret.insert(ret.end(), tris.begin() + 3*t, tris.begin() + 3*t + 3);
+			}
+			return ret;
+		};
+
+		std::vector< std::vector< uint32_t > > levels;
+		levels.reserve(targets.size());
+		while (levels.size() < targets.size()) {
+			if (alive <= targets[levels.size()] || queue.empty()) {
+				//(if nothing more can collapse, the remaining levels are all the same)
+				levels.emplace_back(snapshot());
+				continue;
+			}
+
+			Collapse collapse = queue.top();
+			queue.pop();
+			uint32_t from = collapse.from, to = collapse.to;
+			if (!point_alive[from] || !point_alive[to]) continue;
+			if (stamp[from] != collapse.from_stamp || stamp[to] != collapse.to_stamp) continue;
+			if (!can_collapse(from, to)) continue;
+
+			quadric[to] += quadric[from];
+			for (uint32_t t : point_tris[from]) {
+				if (!tri_alive[t]) continue;
+				if (tri_point(t, 0) == to || tri_point(t, 1) == to || tri_point(t, 2) == to) {
+					tri_alive[t] = false;
+					alive -= 1;
+					continue;
+				}
+				for (uint32_t c = 0; c < 3; ++c) {
+					if (tri_point(t, c) == from) tris[3*t+c] = closest_vertex(tris[3*t+c], to);
+				}
+				point_tris[to].emplace_back(t);
+			}
+			point_alive[from] = false;
+			point_tris[from].clear();
+			stamp[to] += 1;
+
+			//drop dead (and duplicate) triangles from the list around 'to':
+			std::vector< uint32_t > &around = point_tris[to];
+			around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return !tri_alive[t]; }), around.end());
+			std::sort(around.begin(), around.end());
+			around.erase(std::unique(around.begin(), around.end()), around.end());
+
+			push_collapses(to);
+		}
+
+		return levels;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct|in.pnci> <out.pnct|out.pnci>" << std::endl;
+		return 1;
+	}
+	std::string in_file = argv[1];
+	std::string out_file = argv[2];
+
+	if (in_file.size() < 5 || out_file.size() < 5 || in_file.substr(in_file.size() - 5) != out_file.substr(out_file.size() - 5)) {
+		std::cerr << "ERROR: input and output files should have the same format (extension)." << std::endl;
+		return 1;
+	}
+
+	constexpr uint32_t MinTriangles = 64; //don't bother simplifying smaller meshes
+	constexpr uint32_t MinLevelTriangles = 16; //...or simplifying below this
+	constexpr uint32_t MaxLevels = 3;
+
+	try {
+		MeshFile file(in_file);
+
+		//work on an indexed copy (for '.pnct' files, mesh m of the copy is mesh m of the original):
+		MeshFile indexed = file;
+		indexed.make_indexed();
+
+		//meshes that already have levels of detail (or are levels of detail) are skipped:
+		std::set< std::string > names;
+		for (auto const &mesh : file.meshes) names.emplace(mesh.name);
+		auto skip = [&names](std::string const &name) {
+			return name.find("@lod") != std::string::npos || names.count(name + "@lod1");
+		};
+
+		//each distinct index range is simplified once; meshes that share it all get its levels:
+		std::map< std::pair< uint32_t, uint32_t >, std::vector< uint32_t > > users;
+		std::vector< std::pair< uint32_t, uint32_t > > work;
+		for (uint32_t m = 0; m < indexed.meshes.size(); ++m) {
+			auto const &mesh = indexed.meshes[m];
+			if (skip(mesh.name)) continue;
+			auto range = std::make_pair(mesh.index_begin, mesh.index_end);
+			auto &list = users[range];
+			if (list.empty()) work.emplace_back(range);
+			list.emplace_back(m);
+		}
+
+		uint32_t simplified = 0;
+		uint32_t too_small = 0; //(ranges left alone for having fewer than MinTriangles triangles)
+		uint64_t triangles_before = 0;
+		std::vector< uint64_t > triangles_after(MaxLevels, 0);
+
+		for (auto const &range : work) {
+			std::vector< uint32_t > const &list = users[range];
+			MeshFile::Mesh const &mesh = indexed.meshes[list[0]];
+			uint32_t index_count = mesh.index_end - mesh.index_begin;
+			if (index_count % 3 != 0) {
+				std::cerr << "WARNING: skipping mesh '" << mesh.name << "', which isn't made of triangles." << std::endl;
+				continue;
+			}
+			uint32_t triangle_count = index_count / 3;
+			if (triangle_count < MinTriangles) {
+				too_small += 1;
+				continue;
+			}
+
+			std::vector< uint32_t > targets;
+			for (uint32_t target = triangle_count / 2; target >= MinLevelTriangles && targets.size() < MaxLevels; target /= 2) {
+				targets.emplace_back(target);
+			}
+
+			std::vector< std::vector< uint32_t > > levels = simplify(
+				indexed.indices.data() + mesh.index_begin, triangle_count,
+				indexed.vertices.data() + mesh.vertex_begin, mesh.vertex_end - mesh.vertex_begin,
+				targets
+			);
+
+			//keep levels only while they are meaningfully simpler than the level before:
+			uint32_t previous = triangle_count;
+			for (uint32_t l = 0; l < levels.size(); ++l) {
+				uint32_t level_triangles = uint32_t(levels[l].size() / 3);
+				if (level_triangles == 0 || level_triangles * 4 > previous * 3) break;
+				previous = level_triangles;
+
+				MeshFile::Mesh lod;
+				if (file.indexed) {
+					lod.vertex_begin = mesh.vertex_begin;
+					lod.vertex_end = mesh.vertex_end;
+					lod.index_begin = uint32_t(file.indices.size());
+					file.indices.insert(file.indices.end(), levels[l].begin(), levels[l].end());
+					lod.index_end = uint32_t(file.indices.size());
+				} else {
+					lod.vertex_begin = uint32_t(file.vertices.size());
+					for (uint32_t i : levels[l]) {
+						file.vertices.emplace_back(indexed.vertices[mesh.vertex_begin + i]);
+					}
+					lod.vertex_end = uint32_t(file.vertices.size());
+				}
+				for (uint32_t m : list) {
+					lod.name = file.meshes[m].name + "@lod" + std::to_string(l + 1);
+					file.meshes.emplace_back(lod);
+				}
+
+				if (l == 0) {
+					simplified += 1;
+					triangles_before += triangle_count;
+				}
+				triangles_after[l] += level_triangles;
+			}
+		}
+
+		file.save(out_file);
+
+		std::cout << "Simplified " << simplified << " meshes (" << triangles_before << " triangles) from '" << in_file << "' into '" << out_file << "':";
+		for (uint32_t l = 0; l < MaxLevels; ++l) {
+			std::cout << "\n  level " << (l + 1) << ": " << triangles_after[l] << " triangles";
+		}
+		std::cout << std::endl;
+		if (too_small) {
+			std::cout << "  (" << too_small << " of " << work.size() << " meshes have fewer than " << MinTriangles << " triangles, so got no levels of detail)" << std::endl;
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}